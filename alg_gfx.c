@@ -13,12 +13,18 @@
 #include <stdio.h>
 #include <math.h>
 #include <ctype.h>
+#include <stdint.h>
 
 #include <allegro5/allegro.h>
 #include <allegro5/allegro_image.h>
 #include <allegro5/allegro_primitives.h>
 #include <allegro5/allegro_font.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GFX_HAVE_SIMD
+#endif
+
 #include "config.h"
 #include "gfx.h"
 #include "alg_data.h"
@@ -32,77 +38,1895 @@ ALLEGRO_DISPLAY *gfx_display = NULL;
 ALLEGRO_BITMAP  *gfx_screen  = NULL;   /* backbuffer / offscreen surface */
 ALLEGRO_BITMAP  *scanner_image = NULL;
 
+/* where the game screen is in gfx_screen (see gfx.h) */
+int gfx_x_offset = 0;
+int gfx_y_offset = 0;
+
+/* the space view and the area above the console (see gfx.h) */
+int gfx_view_left = 0;
+int gfx_view_top = 0;
+int gfx_view_w = GFX_X_CENTRE * 2;
+int gfx_view_h = GFX_Y_CENTRE * 2;
+int gfx_proj_scale = GFX_Y_CENTRE * 8 / 3;
+
+int gfx_area_left = 0;
+int gfx_area_top = 0;
+int gfx_area_w = GFX_X_CENTRE * 2;
+int gfx_area_h = GFX_Y_CENTRE * 2;
+
+/*
+ * gfx_screen is the frame size; when the display is some other size
+ * the frame is scaled to fit it, keeping its shape, and centred.
+ */
+static float present_x, present_y, present_w, present_h;
+static int present_scaled = 0;
+
 /* built-in font only (per user choice) */
 static ALLEGRO_FONT *font_small = NULL;
 static ALLEGRO_FONT *font_large = NULL;
 
-/* sprite bitmaps (loaded from ./data) */
-static ALLEGRO_BITMAP *sprite_grn_dot   = NULL;
-static ALLEGRO_BITMAP *sprite_red_dot   = NULL;
-static ALLEGRO_BITMAP *sprite_big_s     = NULL;
-static ALLEGRO_BITMAP *sprite_elite_txt = NULL;
-static ALLEGRO_BITMAP *sprite_big_e     = NULL;
-static ALLEGRO_BITMAP *sprite_blake     = NULL;
-static ALLEGRO_BITMAP *sprite_missile_g = NULL;
-static ALLEGRO_BITMAP *sprite_missile_y = NULL;
-static ALLEGRO_BITMAP *sprite_missile_r = NULL;
+/* sprite bitmaps (loaded from ./data) */
+static ALLEGRO_BITMAP *sprite_grn_dot   = NULL;
+static ALLEGRO_BITMAP *sprite_red_dot   = NULL;
+static ALLEGRO_BITMAP *sprite_big_s     = NULL;
+static ALLEGRO_BITMAP *sprite_elite_txt = NULL;
+static ALLEGRO_BITMAP *sprite_big_e     = NULL;
+static ALLEGRO_BITMAP *sprite_blake     = NULL;
+static ALLEGRO_BITMAP *sprite_missile_g = NULL;
+static ALLEGRO_BITMAP *sprite_missile_y = NULL;
+static ALLEGRO_BITMAP *sprite_missile_r = NULL;
+
+/* original code used frame_count + timer; here we use a time-based
+ * frame pacer instead (speed_cap is extern from config/main). */
+extern int speed_cap;
+
+/*
+ * Frame pacing.  Each frame has a deadline that advances by speed_cap
+ * milliseconds, so the time spent drawing does not add to the frame
+ * time and the game runs at the same speed on any machine that keeps
+ * up.  Most of the wait is slept; the last PACE_SPIN_TIME seconds are
+ * spun because al_rest() can oversleep by a scheduler tick.  Build with
+ * -DPACE_DEBUG to print the frame time figures on exit.
+ */
+#define PACE_SPIN_TIME  0.002
+#define PACE_STATS      256     /* frames kept for the jitter figures */
+
+static double last_frame_time = 0.0;
+static double next_frame_time = 0.0;
+static double frame_times[PACE_STATS];
+static int frame_stat_count = 0;
+static int frame_stat_pos = 0;
+
+/*
+ * Polygons queued between gfx_start_render() and gfx_finish_render().
+ * Both arrays grow as needed and are kept from frame to frame.  The
+ * points of each polygon are stored contiguously in poly_points.
+ */
+struct poly_data
+{
+    unsigned int key;       /* sorts ascending = furthest first */
+    int no_points;
+    int face_colour;
+    int first_point;
+};
+
+static struct poly_data *poly_queue = NULL;
+static int *poly_order = NULL;      /* poly_queue indices, sorted */
+static int *poly_sort_tmp = NULL;
+static int poly_queue_size = 0;
+static int total_polys;
+
+static int *poly_points = NULL;
+static int poly_points_size = 0;
+static int total_points;
+
+/* anti-alias flag (extern from config.h) */
+extern int anti_alias_gfx;
+
+/* scanner filename (extern from alg_data.h) */
+extern char scanner_filename[];
+
+/*
+ * Direct framebuffer access.
+ *
+ * Between gfx_acquire_screen() and gfx_release_screen() the 3D view of
+ * gfx_screen is kept locked so that the pixel routines can write straight
+ * into it rather than going through al_put_pixel().  The lock is taken on
+ * first use: when the frame starts with gfx_clear_display() every pixel of
+ * the region is about to be overwritten, so it can be locked write-only and
+ * nothing has to be read back.  Otherwise it is locked read/write.
+ * Anything drawn through Allegro drops the lock first and the next pixel
+ * write takes it again.
+ */
+
+#define LOCK_TX (GFX_X_OFFSET + GFX_AREA_TX)
+#define LOCK_TY (GFX_Y_OFFSET + GFX_AREA_TY)
+#define LOCK_BX (GFX_X_OFFSET + GFX_AREA_BX)
+#define LOCK_BY (GFX_Y_OFFSET + GFX_AREA_BY)
+
+/*
+ * Something the software drawing routines can write into directly: the
+ * locked screen (packed 32-bit pixels) or the 8-bit index buffer.  tx..bx
+ * and ty..by is the part of the screen it covers, in screen coordinates.
+ */
+struct gfx_surface
+{
+    unsigned char *pixels;      /* the pixel at (tx, ty) */
+    int pitch;
+    int bpp;                    /* 1 = palette index, 4 = packed colour */
+    int tx, ty, bx, by;
+};
+
+static ALLEGRO_LOCKED_REGION *screen_lock = NULL;
+static struct gfx_surface lock_surface;
+static int screen_acquired = 0;
+
+/*
+ * Optional 8-bit indexed mode (indexed_gfx in newkind.cfg).  Everything
+ * drawn in the area above the console goes into index_buffer as palette
+ * indices and gfx_update_screen() expands the lot to RGBA in one go.
+ * The console below the view is still drawn through Allegro.
+ */
+#define INDEX_TX (GFX_X_OFFSET + gfx_area_left)
+#define INDEX_TY (GFX_Y_OFFSET + gfx_area_top)
+#define INDEX_W (gfx_area_w)
+#define INDEX_H (gfx_area_h)
+
+static unsigned char *index_buffer = NULL;
+static struct gfx_surface index_surface;
+
+/*
+ * Optional depth buffer (depth_buffer_gfx in newkind.cfg) covering the
+ * same area as the index buffer.  Solid ship faces are then filled
+ * as they arrive instead of being queued and sorted, and each pixel is
+ * tested against the buffer before it is written.  The buffer holds
+ * 1/z, which is linear across a face on the screen; 0 is infinitely far
+ * away.  Only the rows written since the last clear are cleared.
+ */
+#define DEPTH_BIAS (1.0f + 1.0f / 1024)     /* later coplanar faces win */
+
+static float *depth_buffer = NULL;
+static int depth_ty = GFX_VIEW_MAX_H;
+static int depth_by = -1;
+
+/* builtin font glyphs for drawing text into the index buffer */
+static unsigned char font_glyphs[128][8];
+
+/* sprites converted to palette indices; 0 in mask = transparent */
+struct index_sprite
+{
+    int w;
+    int h;
+    unsigned char *pixels;
+    unsigned char *mask;
+};
+
+static struct index_sprite index_sprites[IMG_BLAKE + 1];
+
+/*
+ * Text cache.
+ *
+ * Each distinct (string, font, colour) is drawn once into a slot of a
+ * shared atlas bitmap and copied from there afterwards.  The copies are
+ * made with bitmap drawing held, so a screen full of text goes out as
+ * one batch.  When every slot is taken the least recently used one is
+ * reused.  Strings too long for a slot are drawn directly.
+ */
+#define TEXT_SLOTS      256
+#define TEXT_SLOT_W     512
+#define TEXT_SLOT_H     8
+#define TEXT_MAX_CHARS  64
+#define TEXT_HASH_SIZE  512
+
+struct text_slot
+{
+    char str[TEXT_MAX_CHARS + 1];
+    ALLEGRO_FONT *font;
+    int col;
+    int width;
+    unsigned int last_used;
+    int hash;                   /* -1 = slot not in use */
+    int next;                   /* next slot in the hash chain */
+};
+
+static ALLEGRO_BITMAP *text_atlas = NULL;
+static struct text_slot text_slots[TEXT_SLOTS];
+static int text_hash[TEXT_HASH_SIZE];
+static unsigned int text_clock = 0;
+
+/*
+ * The last few blocks of word-wrapped text, so that redrawing a planet
+ * description or mission briefing does not wrap it all over again.
+ */
+#define WRAP_CACHE_SIZE 4
+#define WRAP_MAX_LINES  32
+
+struct wrap_entry
+{
+    char *txt;                  /* copy of the text, NULL = unused */
+    int maxlen;
+    int num_lines;
+    char lines[WRAP_MAX_LINES][100];
+    unsigned int last_used;
+};
+
+static struct wrap_entry wrap_cache[WRAP_CACHE_SIZE];
+static unsigned int wrap_clock = 0;
+
+/*
+ * Retained layer: a saved copy of part of the view that can be put
+ * back with one blit (or one memcpy per row in indexed mode).  The
+ * charts use it so moving the cursor does not redraw the galaxy.
+ */
+static ALLEGRO_BITMAP *layer_bitmap = NULL;
+static unsigned char *layer_index = NULL;
+static int layer_tx, layer_ty, layer_bx, layer_by;
+
+/* expands a row of palette indices to packed colours */
+static void (*expand_row)(uint32_t *dst, const unsigned char *src, int n);
+
+/* current clip rectangle in screen coordinates (inclusive) */
+static int clip_tx, clip_ty, clip_bx, clip_by;
+
+/*
+ * The game's 256 colour palette, as used by the original Allegro 4
+ * version (it is the palette stored in scanner.bmp).  The GFX_COL_*
+ * values in gfx.h, the planet colour tables in threed.c and the sun
+ * colours are all indices into it.
+ */
+static const unsigned char gfx_palette_rgb[256][3] =
+{
+    {  0,   0,   0}, {128,   0,   0}, {  0, 128,   0}, {128, 128,   0},   /*   0 */
+    {  0,   0, 128}, {128,   0, 128}, {  0, 128, 128}, {192, 192, 192},   /*   4 */
+    {192, 220, 192}, {166, 202, 240}, {  0,  33, 206}, {  0, 255, 206},   /*   8 */
+    { 66,  66,  66}, { 66,  99,   0}, { 66,  99, 206}, { 66, 206,  66},   /*  12 */
+    { 99,  49,   0}, { 99, 173,   0}, { 99, 255,  99}, {107,  66,   8},   /*  16 */
+    {123,  74,   8}, {123, 123, 123}, {132,  82,   8}, {132, 132, 132},   /*  20 */
+    {140,  90,   8}, {140, 173, 239}, {140, 239,   0}, {148,  99,   0},   /*  24 */
+    {156,   0,   0}, {165, 107,   0}, {173,  82,   0}, {173, 123,   0},   /*  28 */
+    {181, 132,   0}, {189, 140,   0}, {189, 189, 189}, {198, 198, 198},   /*  32 */
+    {206,   0, 206}, {206, 156,   0}, {214, 165,   0}, {222, 181,   0},   /*  36 */
+    {239, 239, 239}, { 96,  96,  96}, {  0, 157, 157}, {133,  36, 240},   /*  40 */
+    {  0, 117, 117}, {  1,  73, 163}, {  0,   0, 140}, {223, 179,   2},   /*  44 */
+    {219, 109,   0}, {206,   0,   0}, {176, 176, 176}, {128,  64,   0},   /*  48 */
+    {255, 255, 128}, {102, 204,   0}, {153, 204,   0}, {204, 204,   0},   /*  52 */
+    {255, 204,   0}, {102, 255,   0}, {153, 255,   0}, {204, 255,   0},   /*  56 */
+    {  0,   0,  51}, { 51,   0,  51}, {102,   0,  51}, {153,   0,  51},   /*  60 */
+    {204,   0,  51}, {255,   0,  51}, {  0,  51,  51}, { 51,  51,  51},   /*  64 */
+    {102,  51,  51}, {153,  51,  51}, {204,  51,  51}, {255,  51,  51},   /*  68 */
+    {  0, 102,  51}, { 51, 102,  51}, {102, 102,  51}, {153, 102,  51},   /*  72 */
+    {204, 102,  51}, {255, 102,  51}, {  0, 153,  51}, { 51, 153,  51},   /*  76 */
+    {102, 153,  51}, {153, 153,  51}, {204, 153,  51}, {255, 153,  51},   /*  80 */
+    {  0, 204,  51}, { 51, 204,  51}, {102, 204,  51}, {153, 204,  51},   /*  84 */
+    {204, 204,  51}, {255, 204,  51}, { 51, 255,  51}, {102, 255,  51},   /*  88 */
+    {153, 255,  51}, {204, 255,  51}, {255, 255,  51}, {  0,   0, 102},   /*  92 */
+    { 51,   0, 102}, {102,   0, 102}, {153,   0, 102}, {204,   0, 102},   /*  96 */
+    {255,   0, 102}, {  0,  51, 102}, { 51,  51, 102}, {102,  51, 102},   /* 100 */
+    {153,  51, 102}, {204,  51, 102}, {255,  51, 102}, {  0, 102, 102},   /* 104 */
+    { 51, 102, 102}, {102, 102, 102}, {153, 102, 102}, {204, 102, 102},   /* 108 */
+    {  0, 153, 102}, { 51, 153, 102}, {102, 153, 102}, {153, 153, 102},   /* 112 */
+    {204, 153, 102}, {255, 153, 102}, {  0, 204, 102}, { 51, 204, 102},   /* 116 */
+    {153, 204, 102}, {204, 204, 102}, {255, 204, 102}, {  0, 255, 102},   /* 120 */
+    { 51, 255, 102}, {153, 255, 102}, {204, 255, 102}, {255,   0, 204},   /* 124 */
+    {204,   0, 255}, {  0, 153, 153}, {153,  51, 153}, {153,   0, 153},   /* 128 */
+    {204,   0, 153}, {  0,   0, 153}, { 51,  51, 153}, {102,   0, 153},   /* 132 */
+    {204,  51, 153}, {255,   0, 153}, {  0, 102, 153}, { 51, 102, 153},   /* 136 */
+    {102,  51, 153}, {153, 102, 153}, {204, 102, 153}, {255,  51, 153},   /* 140 */
+    { 51, 153, 153}, {102, 153, 153}, {153, 153, 153}, {204, 153, 153},   /* 144 */
+    {255, 153, 153}, {  0, 204, 153}, { 51, 204, 153}, {102, 204, 102},   /* 148 */
+    {153, 204, 153}, {204, 204, 153}, {255, 204, 153}, {  0, 255, 153},   /* 152 */
+    { 51, 255, 153}, {102, 204, 153}, {153, 255, 153}, {204, 255, 153},   /* 156 */
+    {255, 255, 153}, {  0,   0, 204}, { 51,   0, 153}, {102,   0, 204},   /* 160 */
+    {153,   0, 204}, {204,   0, 204}, {  0,  51, 153}, { 51,  51, 204},   /* 164 */
+    {102,  51, 204}, {153,  51, 204}, {204,  51, 204}, {255,  51, 204},   /* 168 */
+    {  0, 102, 204}, { 51, 102, 204}, {102, 102, 153}, {153, 102, 204},   /* 172 */
+    {204, 102, 204}, {255, 102, 153}, {  0, 153, 204}, { 51, 153, 204},   /* 176 */
+    {102, 153, 204}, {153, 153, 204}, {204, 153, 204}, {255, 153, 204},   /* 180 */
+    {  0, 204, 204}, { 51, 204, 204}, {102, 204, 204}, {153, 204, 204},   /* 184 */
+    {204, 204, 204}, {255, 204, 204}, {  0, 255, 204}, { 51, 255, 204},   /* 188 */
+    {102, 255, 153}, {153, 255, 204}, {204, 255, 204}, {255, 255, 204},   /* 192 */
+    { 51,   0, 204}, {102,   0, 255}, {153,   0, 255}, {  0,  51, 204},   /* 196 */
+    { 51,  51, 255}, {102,  51, 255}, {153,  51, 255}, {204,  51, 255},   /* 200 */
+    {255,  51, 255}, {  0, 102, 255}, {206,   0,   0}, {102, 102, 204},   /* 204 */
+    {153, 102, 255}, {204, 102, 255}, {255, 102, 204}, {  0, 153, 255},   /* 208 */
+    { 51, 153, 255}, {102, 153, 255}, {153, 153, 255}, {204, 153, 255},   /* 212 */
+    {255, 153, 255}, {  0, 204, 255}, { 51, 204, 255}, {102, 204, 255},   /* 216 */
+    {153, 204, 255}, {204, 204, 255}, {255, 204, 255}, { 51, 255, 255},   /* 220 */
+    {102, 255, 204}, {153, 255, 255}, {204, 255, 255}, {255, 102, 102},   /* 224 */
+    {102, 255, 102}, {255, 255, 102}, {102, 102, 255}, {255, 102, 255},   /* 228 */
+    {102, 255, 255}, {165,   0,  33}, { 95,  95,  95}, {119, 119, 119},   /* 232 */
+    {134, 134, 134}, {150, 150, 150}, {203, 203, 203}, {178, 178, 178},   /* 236 */
+    {215, 215, 215}, {221, 221, 221}, {227, 227, 227}, {234, 234, 234},   /* 240 */
+    {241, 241, 241}, {248, 248, 248}, {255, 251, 240}, {160, 160, 164},   /* 244 */
+    {128, 128, 128}, {255,   0,   0}, {  0, 255,   0}, {255, 255,   0},   /* 248 */
+    {  0,   0, 255}, {255,   0, 255}, {  0, 255, 255}, {255, 255, 255}    /* 252 */
+};
+
+/* palette as Allegro colours and as packed screen pixels, built at startup */
+static ALLEGRO_COLOR gfx_palette[256];
+static uint32_t gfx_palette_packed[256];
+
+/* ----------------------------------------------------------------------
+ * Small helpers
+ * --------------------------------------------------------------------*/
+
+/*
+ * Build the ALLEGRO_COLOR and packed forms of the palette.  The packed
+ * form matches the ABGR_8888_LE layout used for the locked screen, which
+ * is R, G, B, A in memory whatever the byte order of the machine.
+ */
+static void gfx_build_palette(void)
+{
+    unsigned char rgba[4];
+    int i;
+
+    for (i = 0; i < 256; i++)
+    {
+        rgba[0] = gfx_palette_rgb[i][0];
+        rgba[1] = gfx_palette_rgb[i][1];
+        rgba[2] = gfx_palette_rgb[i][2];
+        rgba[3] = 255;
+
+        gfx_palette[i] = al_map_rgb(rgba[0], rgba[1], rgba[2]);
+        memcpy(&gfx_palette_packed[i], rgba, sizeof(uint32_t));
+    }
+}
+
+/*
+ * Primitive batching.
+ *
+ * Lines, filled triangles and rectangles and single points drawn through
+ * Allegro are collected in one vertex array and sent with a single
+ * al_draw_prim() call.  The batch is flushed when the primitive type
+ * changes, before anything else is drawn through Allegro, before the clip
+ * rectangle changes, before the screen is locked and in gfx_update_screen().
+ * The screen is never locked while the batch holds anything, so pixels
+ * written directly cannot get ahead of primitives still waiting in it.
+ */
+
+#define BATCH_SIZE 3072
+
+/* batch_type for a run of bitmap copies made with drawing held */
+#define BATCH_BITMAPS -1
+
+static ALLEGRO_VERTEX batch_vtx[BATCH_SIZE];
+static int batch_count = 0;
+static int batch_type = ALLEGRO_PRIM_LINE_LIST;
+
+static void gfx_flush_batch(void)
+{
+    if (batch_count == 0)
+        return;
+
+    if (batch_type == BATCH_BITMAPS)
+    {
+        al_hold_bitmap_drawing(false);
+    }
+    else
+    {
+        al_set_target_bitmap(gfx_screen);
+        al_draw_prim(batch_vtx, NULL, NULL, 0, batch_count, batch_type);
+    }
+
+    batch_count = 0;
+}
+
+static void gfx_lock_screen(int flags)
+{
+    if (screen_lock)
+        return;
+
+    gfx_flush_batch();
+
+    screen_lock = al_lock_bitmap_region(gfx_screen, LOCK_TX, LOCK_TY,
+                                        LOCK_BX - LOCK_TX + 1,
+                                        LOCK_BY - LOCK_TY + 1,
+                                        ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+                                        flags);
+    if (!screen_lock)
+        return;
+
+    lock_surface.pixels = screen_lock->data;
+    lock_surface.pitch  = screen_lock->pitch;
+    lock_surface.bpp    = 4;
+    lock_surface.tx     = LOCK_TX;
+    lock_surface.ty     = LOCK_TY;
+    lock_surface.bx     = LOCK_BX;
+    lock_surface.by     = LOCK_BY;
+}
+
+static void gfx_unlock_screen(void)
+{
+    if (!screen_lock)
+        return;
+
+    al_unlock_bitmap(gfx_screen);
+    screen_lock = NULL;
+}
+
+/* Make gfx_screen the target for an (unbatched) Allegro drawing call. */
+static void gfx_target_screen(void)
+{
+    gfx_flush_batch();
+    gfx_unlock_screen();
+    al_set_target_bitmap(gfx_screen);
+}
+
+/* Make room for n vertices of the given type and return the first. */
+static ALLEGRO_VERTEX *gfx_batch(int type, int n)
+{
+    ALLEGRO_VERTEX *v;
+
+    if (type != batch_type || batch_count + n > BATCH_SIZE)
+    {
+        gfx_flush_batch();
+        batch_type = type;
+    }
+
+    gfx_unlock_screen();
+
+    v = &batch_vtx[batch_count];
+    batch_count += n;
+    return v;
+}
+
+/* Get ready for a bitmap copy onto gfx_screen that may be held. */
+static void gfx_batch_bitmap(void)
+{
+    if (batch_type != BATCH_BITMAPS || batch_count == 0)
+    {
+        gfx_flush_batch();
+        gfx_unlock_screen();
+        al_set_target_bitmap(gfx_screen);
+        al_hold_bitmap_drawing(true);
+        batch_type = BATCH_BITMAPS;
+    }
+
+    batch_count++;
+}
+
+static void gfx_set_vertex(ALLEGRO_VERTEX *v, float x, float y, int col)
+{
+    v->x = x;
+    v->y = y;
+    v->z = 0;
+    v->u = 0;
+    v->v = 0;
+    v->color = gfx_palette[col];
+}
+
+/* One pixel wide line between pixel centres (screen coordinates). */
+static void gfx_batch_line(int x1, int y1, int x2, int y2, int col)
+{
+    ALLEGRO_VERTEX *v = gfx_batch(ALLEGRO_PRIM_LINE_LIST, 2);
+
+    gfx_set_vertex(&v[0], x1 + 0.5f, y1 + 0.5f, col);
+    gfx_set_vertex(&v[1], x2 + 0.5f, y2 + 0.5f, col);
+}
+
+/*
+ * Anti-aliased line between pixel centres: a strip two pixels wide that
+ * fades from the full colour along the line to nothing at its edges, as
+ * four triangles.  The colours are premultiplied for Allegro's default
+ * blender.
+ */
+static void gfx_batch_aa_line(int x1, int y1, int x2, int y2, int col)
+{
+    ALLEGRO_VERTEX *v = gfx_batch(ALLEGRO_PRIM_TRIANGLE_LIST, 12);
+    ALLEGRO_COLOR clear = al_map_rgba(0, 0, 0, 0);
+    float ax = x1 + 0.5f, ay = y1 + 0.5f;
+    float bx = x2 + 0.5f, by = y2 + 0.5f;
+    float nx, ny, len;
+    int i;
+
+    nx = ay - by;
+    ny = bx - ax;
+    len = sqrtf(nx * nx + ny * ny);
+    if (len > 0)
+    {
+        nx /= len;
+        ny /= len;
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        gfx_set_vertex(&v[0], ax, ay, col);
+        gfx_set_vertex(&v[1], bx, by, col);
+        gfx_set_vertex(&v[2], bx + nx, by + ny, col);
+        gfx_set_vertex(&v[3], ax, ay, col);
+        gfx_set_vertex(&v[4], bx + nx, by + ny, col);
+        gfx_set_vertex(&v[5], ax + nx, ay + ny, col);
+        v[2].color = clear;
+        v[4].color = clear;
+        v[5].color = clear;
+
+        nx = -nx;
+        ny = -ny;
+        v += 6;
+    }
+}
+
+static void gfx_batch_point(int x, int y, int col)
+{
+    gfx_set_vertex(gfx_batch(ALLEGRO_PRIM_POINT_LIST, 1), x + 0.5f, y + 0.5f, col);
+}
+
+static void gfx_batch_triangle(float x1, float y1, float x2, float y2,
+                               float x3, float y3, int col)
+{
+    ALLEGRO_VERTEX *v = gfx_batch(ALLEGRO_PRIM_TRIANGLE_LIST, 3);
+
+    gfx_set_vertex(&v[0], x1, y1, col);
+    gfx_set_vertex(&v[1], x2, y2, col);
+    gfx_set_vertex(&v[2], x3, y3, col);
+}
+
+/* Same coverage as al_draw_filled_rectangle(tx, ty, bx, by). */
+static void gfx_batch_rectangle(float tx, float ty, float bx, float by, int col)
+{
+    gfx_batch_triangle(tx, ty, bx, ty, bx, by, col);
+    gfx_batch_triangle(tx, ty, bx, by, tx, by, col);
+}
+
+/* The bitmap for one of the IMG_* sprites (NULL if it failed to load). */
+static ALLEGRO_BITMAP *gfx_sprite_bitmap(int sprite_no)
+{
+    switch (sprite_no)
+    {
+    case IMG_GREEN_DOT:
+        return sprite_grn_dot;
+
+    case IMG_RED_DOT:
+        return sprite_red_dot;
+
+    case IMG_BIG_S:
+        return sprite_big_s;
+
+    case IMG_ELITE_TXT:
+        return sprite_elite_txt;
+
+    case IMG_BIG_E:
+        return sprite_big_e;
+
+    case IMG_BLAKE:
+        return sprite_blake;
+
+    case IMG_MISSILE_GREEN:
+        return sprite_missile_g;
+
+    case IMG_MISSILE_YELLOW:
+        return sprite_missile_y;
+
+    case IMG_MISSILE_RED:
+        return sprite_missile_r;
+
+    default:
+        return NULL;
+    }
+}
+
+/* ----------------------------------------------------------------------
+ * Software drawing into a gfx_surface.
+ *
+ * Coordinates are screen coordinates; everything is clipped against
+ * both the surface and the current clip rectangle.
+ * --------------------------------------------------------------------*/
+
+static void sw_pixel(struct gfx_surface *s, int x, int y, int col)
+{
+    unsigned char *row;
+
+    if (x < s->tx || x > s->bx || y < s->ty || y > s->by ||
+        x < clip_tx || x > clip_bx || y < clip_ty || y > clip_by)
+        return;
+
+    row = s->pixels + (y - s->ty) * s->pitch;
+
+    if (s->bpp == 1)
+        row[x - s->tx] = (unsigned char)col;
+    else
+        ((uint32_t *)row)[x - s->tx] = gfx_palette_packed[col];
+}
+
+static void sw_hline(struct gfx_surface *s, int x1, int x2, int y, int col)
+{
+    unsigned char *row;
+    uint32_t *dst;
+    uint32_t pixel;
+    int t;
+
+    if (y < s->ty || y > s->by || y < clip_ty || y > clip_by)
+        return;
+
+    if (x1 > x2)
+    {
+        t = x1;
+        x1 = x2;
+        x2 = t;
+    }
+
+    if (x1 < s->tx)  x1 = s->tx;
+    if (x1 < clip_tx) x1 = clip_tx;
+    if (x2 > s->bx)  x2 = s->bx;
+    if (x2 > clip_bx) x2 = clip_bx;
+
+    if (x1 > x2)
+        return;
+
+    row = s->pixels + (y - s->ty) * s->pitch;
+
+    if (s->bpp == 1)
+    {
+        memset(row + x1 - s->tx, col, x2 - x1 + 1);
+        return;
+    }
+
+    dst = (uint32_t *)row + (x1 - s->tx);
+    pixel = gfx_palette_packed[col];
+    for (t = x2 - x1 + 1; t > 0; t--)
+        *dst++ = pixel;
+}
+
+/* A row of pixels starting at (x, y), one palette index each. */
+static void sw_span(struct gfx_surface *s, int x, int y, int len,
+                    const unsigned char *cols)
+{
+    unsigned char *row;
+    uint32_t *dst;
+    int x2, i;
+
+    if (y < s->ty || y > s->by || y < clip_ty || y > clip_by)
+        return;
+
+    x2 = x + len - 1;
+
+    if (x < s->tx)
+    {
+        cols += s->tx - x;
+        x = s->tx;
+    }
+    if (x < clip_tx)
+    {
+        cols += clip_tx - x;
+        x = clip_tx;
+    }
+    if (x2 > s->bx)  x2 = s->bx;
+    if (x2 > clip_bx) x2 = clip_bx;
+
+    if (x > x2)
+        return;
+
+    row = s->pixels + (y - s->ty) * s->pitch;
+
+    if (s->bpp == 1)
+    {
+        memcpy(row + x - s->tx, cols, x2 - x + 1);
+        return;
+    }
+
+    dst = (uint32_t *)row + (x - s->tx);
+    for (i = 0; i <= x2 - x; i++)
+        dst[i] = gfx_palette_packed[cols[i]];
+}
+
+/* Filled rectangle, corners inclusive. */
+static void sw_rect(struct gfx_surface *s, int tx, int ty, int bx, int by, int col)
+{
+    int y;
+
+    for (y = ty; y <= by; y++)
+        sw_hline(s, tx, bx, y, col);
+}
+
+/*
+ * Trim a line to a rectangle (Liang-Barsky), so that a line running far
+ * off the screen does not cost a step per off-screen pixel.  Returns 0
+ * if none of it is left.
+ */
+static int sw_clip_line(int *x1, int *y1, int *x2, int *y2,
+                        int tx, int ty, int bx, int by)
+{
+    double dx = (double)*x2 - *x1;
+    double dy = (double)*y2 - *y1;
+    double p[4], q[4];
+    double t0 = 0.0;
+    double t1 = 1.0;
+    double r;
+    int i;
+
+    p[0] = -dx;  q[0] = (double)*x1 - tx;
+    p[1] =  dx;  q[1] = (double)bx - *x1;
+    p[2] = -dy;  q[2] = (double)*y1 - ty;
+    p[3] =  dy;  q[3] = (double)by - *y1;
+
+    for (i = 0; i < 4; i++)
+    {
+        if (p[i] == 0.0)
+        {
+            if (q[i] < 0.0)
+                return 0;
+            continue;
+        }
+
+        r = q[i] / p[i];
+        if (p[i] < 0.0)
+        {
+            if (r > t1)
+                return 0;
+            if (r > t0)
+                t0 = r;
+        }
+        else
+        {
+            if (r < t0)
+                return 0;
+            if (r < t1)
+                t1 = r;
+        }
+    }
+
+    *x2 = (int)floor(*x1 + t1 * dx + 0.5);
+    *y2 = (int)floor(*y1 + t1 * dy + 0.5);
+    *x1 = (int)floor(*x1 + t0 * dx + 0.5);
+    *y1 = (int)floor(*y1 + t0 * dy + 0.5);
+    return 1;
+}
+
+/*
+ * Bresenham line, both end points drawn.  The line is trimmed to area
+ * and plotted into s, which may be a part of it; the pixels are then
+ * the same whichever part is being drawn.
+ */
+static void sw_line_within(struct gfx_surface *s, const struct gfx_surface *area,
+                           int x1, int y1, int x2, int y2, int col)
+{
+    int tx = (area->tx > clip_tx) ? area->tx : clip_tx;
+    int ty = (area->ty > clip_ty) ? area->ty : clip_ty;
+    int bx = (area->bx < clip_bx) ? area->bx : clip_bx;
+    int by = (area->by < clip_by) ? area->by : clip_by;
+    int dx, dy, sx, sy, err, e2;
+
+    if (x1 < tx || x1 > bx || y1 < ty || y1 > by ||
+        x2 < tx || x2 > bx || y2 < ty || y2 > by)
+    {
+        if (!sw_clip_line(&x1, &y1, &x2, &y2, tx, ty, bx, by))
+            return;
+    }
+
+    dx = abs(x2 - x1);
+    dy = -abs(y2 - y1);
+    sx = (x1 < x2) ? 1 : -1;
+    sy = (y1 < y2) ? 1 : -1;
+    err = dx + dy;
+
+    if (y1 == y2)
+    {
+        sw_hline(s, x1, x2, y1, col);
+        return;
+    }
+
+    for (;;)
+    {
+        sw_pixel(s, x1, y1, col);
+
+        if (x1 == x2 && y1 == y2)
+            break;
+
+        e2 = 2 * err;
+        if (e2 >= dy)
+        {
+            err += dy;
+            x1 += sx;
+        }
+        if (e2 <= dx)
+        {
+            err += dx;
+            y1 += sy;
+        }
+    }
+}
+
+static void sw_line(struct gfx_surface *s, int x1, int y1, int x2, int y2, int col)
+{
+    sw_line_within(s, s, x1, y1, x2, y2, col);
+}
+
+/* Midpoint circle, outline or filled. */
+static void sw_circle(struct gfx_surface *s, int cx, int cy, int radius,
+                      int col, int filled)
+{
+    int x = 0;
+    int y = radius;
+    int d = 1 - radius;
+
+    if (radius < 0)
+        return;
+
+    while (x <= y)
+    {
+        if (filled)
+        {
+            sw_hline(s, cx - y, cx + y, cy + x, col);
+            sw_hline(s, cx - y, cx + y, cy - x, col);
+            sw_hline(s, cx - x, cx + x, cy + y, col);
+            sw_hline(s, cx - x, cx + x, cy - y, col);
+        }
+        else
+        {
+            sw_pixel(s, cx + x, cy + y, col);
+            sw_pixel(s, cx - x, cy + y, col);
+            sw_pixel(s, cx + x, cy - y, col);
+            sw_pixel(s, cx - x, cy - y, col);
+            sw_pixel(s, cx + y, cy + x, col);
+            sw_pixel(s, cx - y, cy + x, col);
+            sw_pixel(s, cx + y, cy - x, col);
+            sw_pixel(s, cx - y, cy - x, col);
+        }
+
+        if (d < 0)
+        {
+            d += 2 * x + 3;
+        }
+        else
+        {
+            d += 2 * (x - y) + 5;
+            y--;
+        }
+        x++;
+    }
+}
+
+/*
+ * Convex polygon filler.
+ *
+ * The polygon is split at its top vertex into two chains, walked down one
+ * scanline at a time in 16.16 fixed point.  Each row is filled between the
+ * two chains, taking whichever is further left as the left edge so the
+ * winding does not matter.  A pixel is filled when its centre is inside,
+ * the same rule al_draw_filled_polygon uses.  The rows and spans are
+ * clipped up front to the surface, the clip rectangle and the GFX_VIEW_*
+ * rectangle, so nothing is tested per pixel.
+ *
+ * Given a depth plane (1/z = a * x + b * y + c in screen coordinates)
+ * the polygon goes through the depth buffer instead: a pixel is only
+ * written if it is at least as near as what is already there.
+ */
+
+struct sw_edge
+{
+    int i;          /* vertex the current edge ends at */
+    int dir;        /* +1 or -1 through the point list */
+    int y_end;      /* first row the edge no longer covers */
+    int64_t x;      /* x at the centre of the current row, 16.16 */
+    int64_t dx;     /* change in x per row */
+};
+
+/*
+ * Move a chain on to the edge covering row y.  Returns 0 if there is
+ * none, which can only happen for a polygon that is not really convex.
+ */
+static int sw_edge_setup(struct sw_edge *e, int num_points, const int *pts, int y)
+{
+    int x0, y0, x1, y1;
+    int next;
+    int steps;
+
+    for (steps = 0; steps < num_points; steps++)
+    {
+        next = e->i + e->dir;
+        if (next < 0)
+            next = num_points - 1;
+        else if (next == num_points)
+            next = 0;
+
+        x0 = pts[e->i * 2];
+        y0 = pts[e->i * 2 + 1];
+        x1 = pts[next * 2];
+        y1 = pts[next * 2 + 1];
+        e->i = next;
+
+        if (y1 > y && y0 <= y)
+        {
+            e->y_end = y1;
+            e->dx = ((int64_t)(x1 - x0) << 16) / (y1 - y0);
+            e->x = ((int64_t)x0 << 16) + e->dx * (y - y0) + e->dx / 2;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Fill x0..x1 of row y where the face is nearest. */
+static void sw_depth_span(struct gfx_surface *s, int x0, int x1, int y,
+                          const float *depth, int col)
+{
+    unsigned char *row;
+    float *zb;
+    float w;
+    uint32_t pixel;
+    int x;
+
+    row = s->pixels + (y - s->ty) * s->pitch;
+    zb = depth_buffer + (y - INDEX_TY) * INDEX_W + (x0 - INDEX_TX);
+    w = depth[0] * x0 + depth[1] * y + depth[2];
+    pixel = gfx_palette_packed[col];
+
+    for (x = x0; x <= x1; x++, zb++, w += depth[0])
+    {
+        if (w * DEPTH_BIAS < *zb)
+            continue;
+
+        *zb = w;
+
+        if (s->bpp == 1)
+            row[x - s->tx] = (unsigned char)col;
+        else
+            ((uint32_t *)row)[x - s->tx] = pixel;
+    }
+
+    if (y - INDEX_TY < depth_ty)
+        depth_ty = y - INDEX_TY;
+    if (y - INDEX_TY > depth_by)
+        depth_by = y - INDEX_TY;
+}
+
+static void sw_convex_polygon(struct gfx_surface *s, int num_points, const int *pts,
+                              const float *depth, int col)
+{
+    struct sw_edge left, right;
+    int64_t xl, xr;
+    unsigned char *row;
+    uint32_t *dst;
+    uint32_t pixel;
+    int top, ymin, ymax;
+    int cx0, cy0, cx1, cy1;
+    int x0, x1, y, i;
+
+    if (num_points < 3)
+        return;
+
+    top = 0;
+    ymin = ymax = pts[1];
+    for (i = 1; i < num_points; i++)
+    {
+        if (pts[i * 2 + 1] < ymin)
+        {
+            ymin = pts[i * 2 + 1];
+            top = i;
+        }
+        if (pts[i * 2 + 1] > ymax)
+            ymax = pts[i * 2 + 1];
+    }
+
+    cx0 = GFX_VIEW_TX + GFX_X_OFFSET;
+    cy0 = GFX_VIEW_TY + GFX_Y_OFFSET;
+    cx1 = GFX_VIEW_BX + GFX_X_OFFSET;
+    cy1 = GFX_VIEW_BY + GFX_Y_OFFSET;
+
+    if (cx0 < s->tx)  cx0 = s->tx;
+    if (cx0 < clip_tx) cx0 = clip_tx;
+    if (cy0 < s->ty)  cy0 = s->ty;
+    if (cy0 < clip_ty) cy0 = clip_ty;
+    if (cy0 < ymin)   cy0 = ymin;
+    if (cx1 > s->bx)  cx1 = s->bx;
+    if (cx1 > clip_bx) cx1 = clip_bx;
+    if (cy1 > s->by)  cy1 = s->by;
+    if (cy1 > clip_by) cy1 = clip_by;
+    if (cy1 > ymax - 1) cy1 = ymax - 1;
+
+    if (cx0 > cx1 || cy0 > cy1)
+        return;
+
+    left.i = top;
+    left.dir = -1;
+    right.i = top;
+    right.dir = 1;
+
+    if (!sw_edge_setup(&left, num_points, pts, cy0) ||
+        !sw_edge_setup(&right, num_points, pts, cy0))
+        return;
+
+    pixel = gfx_palette_packed[col];
+
+    for (y = cy0; y <= cy1; y++)
+    {
+        if (y >= left.y_end && !sw_edge_setup(&left, num_points, pts, y))
+            return;
+        if (y >= right.y_end && !sw_edge_setup(&right, num_points, pts, y))
+            return;
+
+        xl = left.x;
+        xr = right.x;
+        if (xl > xr)
+        {
+            xl = right.x;
+            xr = left.x;
+        }
+
+        left.x += left.dx;
+        right.x += right.dx;
+
+        /* first pixel whose centre is at or right of xl, last left of xr */
+        if (xl > ((int64_t)cx1 << 16) + 0x8000 || xr <= ((int64_t)cx0 << 16) + 0x8000)
+            continue;
+
+        x0 = (int)((xl + 0x7FFF) >> 16);
+        x1 = (int)((xr + 0x7FFF) >> 16) - 1;
+        if (x0 < cx0) x0 = cx0;
+        if (x1 > cx1) x1 = cx1;
+        if (x0 > x1)
+            continue;
+
+        if (depth)
+        {
+            sw_depth_span(s, x0, x1, y, depth, col);
+            continue;
+        }
+
+        row = s->pixels + (y - s->ty) * s->pitch;
+
+        if (s->bpp == 1)
+        {
+            memset(row + x0 - s->tx, col, x1 - x0 + 1);
+        }
+        else
+        {
+            dst = (uint32_t *)row + (x0 - s->tx);
+            for (i = x1 - x0; i >= 0; i--)
+                *dst++ = pixel;
+        }
+    }
+}
+
+static void sw_text(struct gfx_surface *s, int x, int y, const char *txt, int col)
+{
+    const unsigned char *str = (const unsigned char *)txt;
+    int row, bit;
+    unsigned char bits;
+
+    for (; *str; str++, x += 8)
+    {
+        if (*str >= 128)
+            continue;
+
+        for (row = 0; row < 8; row++)
+        {
+            bits = font_glyphs[*str][row];
+            for (bit = 0; bits; bit++, bits <<= 1)
+            {
+                if (bits & 0x80)
+                    sw_pixel(s, x + bit, y + row, col);
+            }
+        }
+    }
+}
+
+static void sw_sprite(struct gfx_surface *s, struct index_sprite *spr, int x, int y)
+{
+    int i, j;
+
+    for (j = 0; j < spr->h; j++)
+    {
+        for (i = 0; i < spr->w; i++)
+        {
+            if (spr->mask[j * spr->w + i])
+                sw_pixel(s, x + i, y + j, spr->pixels[j * spr->w + i]);
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------
+ * Job pool
+ *
+ * A pool of worker threads, started with the graphics, that runs
+ * numbered jobs together with the main thread.  gfx_run_parallel() hands
+ * out the jobs and waits for them all to finish.  The tile renderer below
+ * fills its tiles with it and the landscape generator makes its columns
+ * with it.
+ * --------------------------------------------------------------------*/
+
+#define MAX_RENDER_THREADS  16
+
+static ALLEGRO_THREAD *job_workers[MAX_RENDER_THREADS];
+static int num_job_workers = 0;         /* besides the main thread */
+static ALLEGRO_MUTEX *job_mutex = NULL;
+static ALLEGRO_COND *job_start_cond = NULL;
+static ALLEGRO_COND *job_done_cond = NULL;
+static int job_round = 0;               /* bumped to set the workers going */
+static void (*job_func)(int n, void *arg);
+static void *job_arg;
+static int job_count;                   /* how many jobs there are */
+static int job_next;                    /* next job to be taken */
+static int job_busy;                    /* workers not yet finished */
+
+/* Take jobs until there are none left. */
+static void gfx_take_jobs(void)
+{
+    int t;
+
+    for (;;)
+    {
+        al_lock_mutex(job_mutex);
+        t = job_next++;
+        al_unlock_mutex(job_mutex);
+
+        if (t >= job_count)
+            return;
+
+        job_func(t, job_arg);
+    }
+}
+
+static void *gfx_job_worker(ALLEGRO_THREAD *thread, void *arg)
+{
+    int last_round = 0;
+
+    (void)arg;
+
+    al_lock_mutex(job_mutex);
+
+    for (;;)
+    {
+        while (job_round == last_round && !al_get_thread_should_stop(thread))
+            al_wait_cond(job_start_cond, job_mutex);
+
+        if (al_get_thread_should_stop(thread))
+            break;
+
+        last_round = job_round;
+        al_unlock_mutex(job_mutex);
+
+        gfx_take_jobs();
+
+        al_lock_mutex(job_mutex);
+        if (--job_busy == 0)
+            al_broadcast_cond(job_done_cond);
+    }
+
+    al_unlock_mutex(job_mutex);
+    return NULL;
+}
+
+/*
+ * Run job(0, arg) to job(count - 1, arg) on the workers and the main
+ * thread, in no particular order, and return when they have all
+ * finished.  Without workers they are just run in turn.
+ */
+void gfx_run_parallel(void (*job)(int n, void *arg), int count, void *arg)
+{
+    int i;
+
+    if (num_job_workers == 0)
+    {
+        for (i = 0; i < count; i++)
+            job(i, arg);
+        return;
+    }
+
+    al_lock_mutex(job_mutex);
+    job_func = job;
+    job_arg = arg;
+    job_count = count;
+    job_next = 0;
+    job_busy = num_job_workers;
+    job_round++;
+    al_broadcast_cond(job_start_cond);
+    al_unlock_mutex(job_mutex);
+
+    gfx_take_jobs();
+
+    al_lock_mutex(job_mutex);
+    while (job_busy > 0)
+        al_wait_cond(job_done_cond, job_mutex);
+    al_unlock_mutex(job_mutex);
+}
+
+/*
+ * Start the workers: render_threads in newkind.cfg says how many threads
+ * run jobs in all, 0 meaning one per CPU.  If anything fails the jobs
+ * are simply run on the main thread.
+ */
+static void gfx_start_job_pool(void)
+{
+    int n;
+
+    n = (render_threads > 0) ? render_threads : al_get_cpu_count();
+    if (n > MAX_RENDER_THREADS)
+        n = MAX_RENDER_THREADS;
+    if (n <= 1)
+        return;
+
+    job_mutex = al_create_mutex();
+    job_start_cond = al_create_cond();
+    job_done_cond = al_create_cond();
+    if (!job_mutex || !job_start_cond || !job_done_cond)
+        return;
+
+    for (num_job_workers = 0; num_job_workers < n - 1; num_job_workers++)
+    {
+        job_workers[num_job_workers] = al_create_thread(gfx_job_worker, NULL);
+        if (!job_workers[num_job_workers])
+            break;
+        al_start_thread(job_workers[num_job_workers]);
+    }
+}
+
+static void gfx_stop_job_pool(void)
+{
+    int i;
+
+    for (i = 0; i < num_job_workers; i++)
+        al_set_thread_should_stop(job_workers[i]);
+
+    if (job_mutex)
+    {
+        al_lock_mutex(job_mutex);
+        al_broadcast_cond(job_start_cond);
+        al_unlock_mutex(job_mutex);
+    }
+
+    for (i = 0; i < num_job_workers; i++)
+    {
+        al_join_thread(job_workers[i], NULL);
+        al_destroy_thread(job_workers[i]);
+    }
+    num_job_workers = 0;
+
+    if (job_done_cond)
+        al_destroy_cond(job_done_cond);
+    if (job_start_cond)
+        al_destroy_cond(job_start_cond);
+    if (job_mutex)
+        al_destroy_mutex(job_mutex);
+    job_done_cond = NULL;
+    job_start_cond = NULL;
+    job_mutex = NULL;
+}
+
+/* ----------------------------------------------------------------------
+ * Tile renderer
+ *
+ * When the queued polygons are filled in software and there are enough
+ * of them, gfx_finish_render() bins them into 64x64 tiles of the area,
+ * in sorted order, and the tiles are filled in parallel on the job pool.
+ * Each tile is only ever touched by one thread and takes its polygons in
+ * the order they were binned, so the result is the same as filling them
+ * one after another.
+ * --------------------------------------------------------------------*/
+
+#define TILE_SIZE           64
+#define TILES_X             ((INDEX_W + TILE_SIZE - 1) / TILE_SIZE)
+#define TILES_Y             ((INDEX_H + TILE_SIZE - 1) / TILE_SIZE)
+#define TILE_MIN_POLYS      64      /* fewer are not worth handing out */
+
+struct tile_bin
+{
+    int *polys;                 /* poly_queue indices, furthest first */
+    int count;
+    int size;
+};
+
+static struct tile_bin *tile_bins = NULL;     /* TILES_X * TILES_Y of them */
+
+/* Fill one tile from its bin. */
+static void gfx_render_tile(int t, void *arg)
+{
+    struct gfx_surface *tile_surface = arg;
+    struct gfx_surface tile;
+    struct poly_data *poly;
+    int spts[32];
+    int *pl;
+    int i, j;
+
+    tile = *tile_surface;
+    tile.tx = INDEX_TX + (t % TILES_X) * TILE_SIZE;
+    tile.ty = INDEX_TY + (t / TILES_X) * TILE_SIZE;
+    tile.bx = tile.tx + TILE_SIZE - 1;
+    tile.by = tile.ty + TILE_SIZE - 1;
+
+    if (tile.tx < tile_surface->tx) tile.tx = tile_surface->tx;
+    if (tile.ty < tile_surface->ty) tile.ty = tile_surface->ty;
+    if (tile.bx > tile_surface->bx) tile.bx = tile_surface->bx;
+    if (tile.by > tile_surface->by) tile.by = tile_surface->by;
+
+    if (tile.tx > tile.bx || tile.ty > tile.by)
+        return;
+
+    tile.pixels = tile_surface->pixels +
+                  (tile.ty - tile_surface->ty) * tile_surface->pitch +
+                  (tile.tx - tile_surface->tx) * tile_surface->bpp;
+
+    for (i = 0; i < tile_bins[t].count; i++)
+    {
+        poly = &poly_queue[tile_bins[t].polys[i]];
+        pl = &poly_points[poly->first_point];
+
+        for (j = 0; j < poly->no_points * 2; j += 2)
+        {
+            spts[j] = pl[j] + GFX_X_OFFSET;
+            spts[j + 1] = pl[j + 1] + GFX_Y_OFFSET;
+        }
+
+        if (poly->no_points == 2)
+            sw_line_within(&tile, tile_surface, spts[0], spts[1], spts[2], spts[3],
+                           poly->face_colour);
+        else
+            sw_convex_polygon(&tile, poly->no_points, spts, NULL, poly->face_colour);
+    }
+}
+
+/*
+ * Put the queued polygons into the bins of the tiles they cover.
+ * Returns 0 if a bin could not be grown.
+ */
+static int gfx_bin_polys(void)
+{
+    struct poly_data *poly;
+    struct tile_bin *bin;
+    void *mem;
+    int *pl;
+    int tx, ty, bx, by;
+    int x, y, i, j;
+
+    if (!tile_bins)
+    {
+        tile_bins = calloc(TILES_X * TILES_Y, sizeof(struct tile_bin));
+        if (!tile_bins)
+            return 0;
+    }
+
+    for (i = 0; i < TILES_X * TILES_Y; i++)
+        tile_bins[i].count = 0;
+
+    for (i = 0; i < total_polys; i++)
+    {
+        poly = &poly_queue[poly_order[i]];
+        if (poly->no_points < 2 || poly->no_points > 16)
+            continue;
+
+        pl = &poly_points[poly->first_point];
+        tx = bx = pl[0];
+        ty = by = pl[1];
+
+        for (j = 2; j < poly->no_points * 2; j += 2)
+        {
+            if (pl[j] < tx) tx = pl[j];
+            if (pl[j] > bx) bx = pl[j];
+            if (pl[j + 1] < ty) ty = pl[j + 1];
+            if (pl[j + 1] > by) by = pl[j + 1];
+        }
+
+        tx -= gfx_area_left;
+        bx -= gfx_area_left;
+        ty -= gfx_area_top;
+        by -= gfx_area_top;
+
+        if (bx < 0 || tx >= INDEX_W || by < 0 || ty >= INDEX_H)
+            continue;
+
+        tx = (tx < 0) ? 0 : tx / TILE_SIZE;
+        ty = (ty < 0) ? 0 : ty / TILE_SIZE;
+        bx = (bx >= INDEX_W) ? TILES_X - 1 : bx / TILE_SIZE;
+        by = (by >= INDEX_H) ? TILES_Y - 1 : by / TILE_SIZE;
+
+        for (y = ty; y <= by; y++)
+        {
+            for (x = tx; x <= bx; x++)
+            {
+                bin = &tile_bins[y * TILES_X + x];
+
+                if (bin->count == bin->size)
+                {
+                    mem = realloc(bin->polys, (bin->size ? bin->size * 2 : 256) * sizeof(int));
+                    if (!mem)
+                        return 0;
+                    bin->polys = mem;
+                    bin->size = bin->size ? bin->size * 2 : 256;
+                }
+
+                bin->polys[bin->count++] = poly_order[i];
+            }
+        }
+    }
+
+    return 1;
+}
+
+static void gfx_free_tile_bins(void)
+{
+    int i;
+
+    if (!tile_bins)
+        return;
+
+    for (i = 0; i < TILES_X * TILES_Y; i++)
+        free(tile_bins[i].polys);
+
+    free(tile_bins);
+    tile_bins = NULL;
+}
+
+/* ----------------------------------------------------------------------
+ * 8-bit indexed mode
+ * --------------------------------------------------------------------*/
+
+static void expand_row_c(uint32_t *dst, const unsigned char *src, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = gfx_palette_packed[src[i]];
+}
+
+#ifdef GFX_HAVE_SIMD
+
+/* SSE2 has no gather: look up sixteen at a time and store them four wide. */
+__attribute__((target("sse2")))
+static void expand_row_sse2(uint32_t *dst, const unsigned char *src, int n)
+{
+    const uint32_t *pal = gfx_palette_packed;
+    __m128i idx;
+    int w0, w1, w2, w3, w4, w5, w6, w7;
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        idx = _mm_loadu_si128((const __m128i *)(src + i));
+        w0 = _mm_extract_epi16(idx, 0);
+        w1 = _mm_extract_epi16(idx, 1);
+        w2 = _mm_extract_epi16(idx, 2);
+        w3 = _mm_extract_epi16(idx, 3);
+        w4 = _mm_extract_epi16(idx, 4);
+        w5 = _mm_extract_epi16(idx, 5);
+        w6 = _mm_extract_epi16(idx, 6);
+        w7 = _mm_extract_epi16(idx, 7);
+
+        _mm_storeu_si128((__m128i *)(dst + i),
+            _mm_setr_epi32(pal[w0 & 255], pal[w0 >> 8], pal[w1 & 255], pal[w1 >> 8]));
+        _mm_storeu_si128((__m128i *)(dst + i + 4),
+            _mm_setr_epi32(pal[w2 & 255], pal[w2 >> 8], pal[w3 & 255], pal[w3 >> 8]));
+        _mm_storeu_si128((__m128i *)(dst + i + 8),
+            _mm_setr_epi32(pal[w4 & 255], pal[w4 >> 8], pal[w5 & 255], pal[w5 >> 8]));
+        _mm_storeu_si128((__m128i *)(dst + i + 12),
+            _mm_setr_epi32(pal[w6 & 255], pal[w6 >> 8], pal[w7 & 255], pal[w7 >> 8]));
+    }
+
+    for (; i < n; i++)
+        dst[i] = pal[src[i]];
+}
+
+/* AVX2: widen the indices to 32 bits and gather eight colours at once. */
+__attribute__((target("avx2")))
+static void expand_row_avx2(uint32_t *dst, const unsigned char *src, int n)
+{
+    const int *pal = (const int *)gfx_palette_packed;
+    __m128i idx;
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        idx = _mm_loadu_si128((const __m128i *)(src + i));
+
+        _mm256_storeu_si256((__m256i *)(dst + i),
+            _mm256_i32gather_epi32(pal, _mm256_cvtepu8_epi32(idx), 4));
+        _mm256_storeu_si256((__m256i *)(dst + i + 8),
+            _mm256_i32gather_epi32(pal, _mm256_cvtepu8_epi32(_mm_srli_si128(idx, 8)), 4));
+    }
+
+    for (; i < n; i++)
+        dst[i] = gfx_palette_packed[src[i]];
+}
+
+#endif
+
+static void gfx_select_expand_row(void)
+{
+    expand_row = expand_row_c;
+
+#ifdef GFX_HAVE_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        expand_row = expand_row_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        expand_row = expand_row_sse2;
+#endif
+}
+
+/* Pull the builtin font's glyphs out as 8x8 bit masks. */
+static void gfx_build_glyphs(void)
+{
+    ALLEGRO_BITMAP *bmp;
+    ALLEGRO_LOCKED_REGION *lr;
+    unsigned char *p;
+    char str[2];
+    int flags;
+    int c, x, y;
+
+    memset(font_glyphs, 0, sizeof(font_glyphs));
+
+    flags = al_get_new_bitmap_flags();
+    al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+    bmp = al_create_bitmap(128 * 8, 8);
+    al_set_new_bitmap_flags(flags);
+    if (!bmp)
+        return;
+
+    al_set_target_bitmap(bmp);
+    al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+
+    str[1] = '\0';
+    for (c = 32; c < 128; c++)
+    {
+        str[0] = (char)c;
+        al_draw_text(font_small, al_map_rgb(255, 255, 255), c * 8, 0, 0, str);
+    }
+
+    lr = al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY);
+    if (lr)
+    {
+        for (c = 32; c < 128; c++)
+        {
+            for (y = 0; y < 8; y++)
+            {
+                p = (unsigned char *)lr->data + y * lr->pitch + c * 8 * 4;
+                for (x = 0; x < 8; x++)
+                {
+                    if (p[x * 4 + 3] >= 128)
+                        font_glyphs[c][y] |= 0x80 >> x;
+                }
+            }
+        }
+        al_unlock_bitmap(bmp);
+    }
+
+    al_destroy_bitmap(bmp);
+}
+
+/* Nearest palette entry to an RGB colour (exact matches come out first). */
+static int gfx_palette_index(int r, int g, int b)
+{
+    int best = 0;
+    int best_dist = 0x7FFFFFFF;
+    int dist, dr, dg, db;
+    int i;
+
+    for (i = 0; i < 256; i++)
+    {
+        dr = r - gfx_palette_rgb[i][0];
+        dg = g - gfx_palette_rgb[i][1];
+        db = b - gfx_palette_rgb[i][2];
+        dist = dr * dr + dg * dg + db * db;
+
+        if (dist < best_dist)
+        {
+            best = i;
+            best_dist = dist;
+            if (dist == 0)
+                break;
+        }
+    }
+
+    return best;
+}
+
+static void gfx_convert_sprite(struct index_sprite *spr, ALLEGRO_BITMAP *bmp)
+{
+    ALLEGRO_LOCKED_REGION *lr;
+    unsigned char *p;
+    int x, y;
+
+    memset(spr, 0, sizeof(*spr));
+    if (!bmp)
+        return;
+
+    lr = al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY);
+    if (!lr)
+        return;
+
+    spr->w = al_get_bitmap_width(bmp);
+    spr->h = al_get_bitmap_height(bmp);
+    spr->pixels = malloc(spr->w * spr->h);
+    spr->mask = malloc(spr->w * spr->h);
+
+    if (spr->pixels && spr->mask)
+    {
+        for (y = 0; y < spr->h; y++)
+        {
+            p = (unsigned char *)lr->data + y * lr->pitch;
+            for (x = 0; x < spr->w; x++, p += 4)
+            {
+                spr->pixels[y * spr->w + x] = gfx_palette_index(p[0], p[1], p[2]);
+                spr->mask[y * spr->w + x] = (p[3] >= 128);
+            }
+        }
+    }
+    else
+    {
+        free(spr->pixels);
+        free(spr->mask);
+        spr->pixels = NULL;
+        spr->mask = NULL;
+        spr->w = spr->h = 0;
+    }
+
+    al_unlock_bitmap(bmp);
+}
+
+static int gfx_create_index_buffer(void)
+{
+    int i;
+
+    index_buffer = calloc(INDEX_W * INDEX_H, 1);
+    if (!index_buffer)
+        return 1;
+
+    index_surface.pixels = index_buffer;
+    index_surface.pitch  = INDEX_W;
+    index_surface.bpp    = 1;
+    index_surface.tx     = INDEX_TX;
+    index_surface.ty     = INDEX_TY;
+    index_surface.bx     = INDEX_TX + INDEX_W - 1;
+    index_surface.by     = INDEX_TY + INDEX_H - 1;
+
+    gfx_select_expand_row();
+    gfx_build_glyphs();
+
+    for (i = 0; i <= IMG_BLAKE; i++)
+        gfx_convert_sprite(&index_sprites[i], gfx_sprite_bitmap(i));
+
+    return 0;
+}
+
+static void gfx_destroy_index_buffer(void)
+{
+    int i;
+
+    for (i = 0; i <= IMG_BLAKE; i++)
+    {
+        free(index_sprites[i].pixels);
+        free(index_sprites[i].mask);
+        memset(&index_sprites[i], 0, sizeof(index_sprites[i]));
+    }
+
+    free(index_buffer);
+    index_buffer = NULL;
+}
+
+/*
+ * Expand the index buffer through the palette into gfx_screen.  The
+ * whole region is rewritten, so it can be locked write-only.
+ */
+static void gfx_present_index_buffer(void)
+{
+    ALLEGRO_LOCKED_REGION *lr;
+    int y;
+
+    gfx_unlock_screen();
+
+    lr = al_lock_bitmap_region(gfx_screen, index_surface.tx, index_surface.ty,
+                               INDEX_W, INDEX_H,
+                               ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+                               ALLEGRO_LOCK_WRITEONLY);
+    if (!lr)
+        return;
+
+    for (y = 0; y < INDEX_H; y++)
+        expand_row((uint32_t *)((unsigned char *)lr->data + y * lr->pitch),
+                   index_buffer + y * INDEX_W, INDEX_W);
+
+    al_unlock_bitmap(gfx_screen);
+}
+
+/*
+ * Write a pixel (screen coordinates) straight into the locked screen.
+ * Returns 0 if the caller has to fall back to al_put_pixel().
+ */
+static int gfx_put_locked_pixel(int x, int y, int col)
+{
+    if (!screen_acquired)
+        return 0;
+
+    if (x < clip_tx || x > clip_bx || y < clip_ty || y > clip_by)
+        return 1;
+
+    if (x < LOCK_TX || x > LOCK_BX || y < LOCK_TY || y > LOCK_BY)
+        return 0;
+
+    gfx_lock_screen(ALLEGRO_LOCK_READWRITE);
+    if (!screen_lock)
+        return 0;
+
+    sw_pixel(&lock_surface, x, y, col);
+    return 1;
+}
+
+/*
+ * Should a primitive whose top edge is on screen row y be drawn into
+ * the index buffer?
+ */
+static int gfx_indexed(int y)
+{
+    return index_buffer != NULL && y <= index_surface.by;
+}
+
+static unsigned int gfx_text_hash(ALLEGRO_FONT *font, const char *str, int col)
+{
+    unsigned int h = 2166136261u;
+
+    while (*str)
+        h = (h ^ (unsigned char)*str++) * 16777619u;
+
+    h = (h ^ (unsigned int)col) * 16777619u;
+    h ^= (unsigned int)((uintptr_t)font >> 4);
+
+    return h % TEXT_HASH_SIZE;
+}
+
+static void gfx_create_text_cache(void)
+{
+    int i;
+
+    for (i = 0; i < TEXT_HASH_SIZE; i++)
+        text_hash[i] = -1;
+
+    for (i = 0; i < TEXT_SLOTS; i++)
+    {
+        text_slots[i].hash = -1;
+        text_slots[i].next = -1;
+    }
+
+    text_atlas = al_create_bitmap(TEXT_SLOT_W, TEXT_SLOT_H * TEXT_SLOTS);
+}
+
+static void gfx_destroy_text_cache(void)
+{
+    if (text_atlas)
+    {
+        al_destroy_bitmap(text_atlas);
+        text_atlas = NULL;
+    }
+}
+
+/* Take a slot out of its hash chain. */
+static void gfx_unlink_text_slot(int slot)
+{
+    int *link = &text_hash[text_slots[slot].hash];
+
+    while (*link != slot)
+        link = &text_slots[*link].next;
+
+    *link = text_slots[slot].next;
+    text_slots[slot].hash = -1;
+    text_slots[slot].next = -1;
+}
+
+/*
+ * Find the atlas slot holding a string, drawing it there if need be.
+ * Returns -1 if the string cannot be cached.
+ */
+static int gfx_text_slot(ALLEGRO_FONT *font, const char *str, int col)
+{
+    struct text_slot *ts;
+    unsigned int h;
+    int slot, i;
+    int width;
+
+    if (!text_atlas || strlen(str) > TEXT_MAX_CHARS)
+        return -1;
+
+    h = gfx_text_hash(font, str, col);
+
+    for (slot = text_hash[h]; slot != -1; slot = text_slots[slot].next)
+    {
+        ts = &text_slots[slot];
+        if (ts->font == font && ts->col == col && strcmp(ts->str, str) == 0)
+        {
+            ts->last_used = ++text_clock;
+            return slot;
+        }
+    }
 
-/* original code used frame_count + timer; here we use a simple
- * time-based frame cap instead (speed_cap is extern from config/main). */
-extern int speed_cap;
+    width = al_get_text_width(font, str);
+    if (width > TEXT_SLOT_W)
+        return -1;
 
-/* for frame limiting */
-static double last_frame_time = 0.0;
+    /* a free slot if there is one, otherwise the least recently used */
+    slot = 0;
+    for (i = 0; i < TEXT_SLOTS; i++)
+    {
+        if (text_slots[i].hash == -1)
+        {
+            slot = i;
+            break;
+        }
+        if (text_slots[i].last_used < text_slots[slot].last_used)
+            slot = i;
+    }
 
-/* polygon sorting chain (unchanged logic) */
-#define MAX_POLYS 100
+    ts = &text_slots[slot];
+    if (ts->hash != -1)
+        gfx_unlink_text_slot(slot);
+
+    strcpy(ts->str, str);
+    ts->font = font;
+    ts->col = col;
+    ts->width = width;
+    ts->last_used = ++text_clock;
+    ts->hash = h;
+    ts->next = text_hash[h];
+    text_hash[h] = slot;
+
+    gfx_flush_batch();
+    al_set_target_bitmap(text_atlas);
+    al_set_clipping_rectangle(0, slot * TEXT_SLOT_H, TEXT_SLOT_W, TEXT_SLOT_H);
+    al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+    al_draw_text(font, gfx_palette[col], 0, slot * TEXT_SLOT_H, 0, str);
+    al_set_target_bitmap(gfx_screen);
 
-static int start_poly;
-static int total_polys;
+    return slot;
+}
 
-struct poly_data
+/*
+ * Word-wrap text to lines of at most maxlen characters, or find it
+ * already wrapped.
+ */
+static struct wrap_entry *gfx_wrap_text(char *txt, int maxlen)
 {
-    int z;
-    int no_points;
-    int face_colour;
-    int point_list[16];
-    int next;
-};
+    struct wrap_entry *we;
+    char *str = txt;
+    char *bptr;
+    int len = (int)strlen(txt);
+    int pos;
+    int i;
 
-static struct poly_data poly_chain[MAX_POLYS];
+    we = &wrap_cache[0];
+    for (i = 0; i < WRAP_CACHE_SIZE; i++)
+    {
+        if (wrap_cache[i].txt && wrap_cache[i].maxlen == maxlen &&
+            strcmp(wrap_cache[i].txt, txt) == 0)
+        {
+            wrap_cache[i].last_used = ++wrap_clock;
+            return &wrap_cache[i];
+        }
 
-/* anti-alias flag (extern from config.h) */
-extern int anti_alias_gfx;
+        if (wrap_cache[i].last_used < we->last_used)
+            we = &wrap_cache[i];
+    }
 
-/* scanner filename (extern from alg_data.h) */
-extern char scanner_filename[];
+    free(we->txt);
+    we->txt = NULL;
+    we->maxlen = maxlen;
+    we->num_lines = 0;
+    we->last_used = ++wrap_clock;
 
-/* ----------------------------------------------------------------------
- * Small helpers
- * --------------------------------------------------------------------*/
+    while (len > 0 && we->num_lines < WRAP_MAX_LINES)
+    {
+        pos = maxlen;
+        if (pos > len)
+            pos = len;
 
-/* Map old palette index (int) to an Allegro 5 color.
- * This is a rough mapping; adjust if you want the original palette exactly.
- */
-static ALLEGRO_COLOR gfx_map_color(int col)
-{
-    switch (col)
-    {
-    case GFX_COL_BLACK:
-        return al_map_rgb(0, 0, 0);
-    case GFX_COL_WHITE:
-        return al_map_rgb(255, 255, 255);
-    case GFX_COL_GREY_2:
-        return al_map_rgb(128, 128, 128);
-    case GFX_COL_RED:
-        return al_map_rgb(255, 0, 0);
-    case GFX_COL_GREEN_1:
-        return al_map_rgb(0, 255, 0);
-    case GFX_COL_YELLOW_1:
-        return al_map_rgb(255, 255, 0);
-    default:
-        return al_map_rgb(200, 200, 200);
+        while ((str[pos] != ' ') && (str[pos] != ',') &&
+               (str[pos] != '.') && (str[pos] != '\0') && pos > 0)
+        {
+            pos--;
+        }
+
+        len = len - pos - 1;
+
+        for (bptr = we->lines[we->num_lines]; pos >= 0; pos--)
+            *bptr++ = *str++;
+
+        *bptr = '\0';
+        we->num_lines++;
     }
+
+    /* if the copy fails the lines are still good for this call */
+    we->txt = malloc(strlen(txt) + 1);
+    if (we->txt)
+        strcpy(we->txt, txt);
+
+    return we;
 }
 
 /* ensure built-in fonts are available */
@@ -126,10 +1950,73 @@ static ALLEGRO_BITMAP *gfx_load_data_bitmap(const char *filename)
  * Startup / Shutdown
  * --------------------------------------------------------------------*/
 
+/*
+ * Work out the view, the area above the console, the frame and the
+ * display sizes from newkind.cfg.  The frame is made big enough for the
+ * game screen and for the view above the console.
+ */
+static void gfx_choose_sizes(int *w, int *h, int *dw, int *dh)
+{
+    float scale;
+    int vw, vh;
+    int above;
+
+    vw = (view_width > 0) ? view_width : GFX_X_CENTRE * 2;
+    vh = (view_height > 0) ? view_height : GFX_Y_CENTRE * 2;
+
+    if (vw < 64) vw = 64;
+    if (vh < 48) vh = 48;
+    if (vw > GFX_VIEW_MAX_W) vw = GFX_VIEW_MAX_W;
+    if (vh > GFX_VIEW_MAX_H) vh = GFX_VIEW_MAX_H;
+
+    gfx_view_w = vw & ~1;
+    gfx_view_h = vh & ~1;
+    gfx_view_left = GFX_X_CENTRE - gfx_view_w / 2;
+    if (gfx_view_h <= GFX_Y_CENTRE * 2)
+        gfx_view_top = GFX_Y_CENTRE - gfx_view_h / 2;
+    else
+        gfx_view_top = GFX_Y_CENTRE * 2 - gfx_view_h;
+
+    gfx_proj_scale = (projection_scale > 0) ? projection_scale : gfx_view_h * 4 / 3;
+
+    gfx_area_left = (gfx_view_left < 0) ? gfx_view_left : 0;
+    gfx_area_top = (gfx_view_top < 0) ? gfx_view_top : 0;
+    gfx_area_w = GFX_X_CENTRE * 2 - 2 * gfx_area_left;
+    gfx_area_h = GFX_Y_CENTRE * 2 - gfx_area_top;
+
+    /* the view and the area can only reach up past the game screen */
+    above = -gfx_area_top;
+
+    *w = (frame_width > 0) ? frame_width : GFX_FRAME_W;
+    *h = (frame_height > 0) ? frame_height : GFX_FRAME_H;
+
+    if (*w < gfx_area_w)
+        *w = gfx_area_w;
+    if (*h < GFX_GAME_SIZE + above)
+        *h = GFX_GAME_SIZE + above;
+
+    gfx_x_offset = (*w - GFX_GAME_SIZE) / 2;
+    gfx_y_offset = (*h - GFX_GAME_SIZE - above) / 2 + above;
+
+    *dw = (window_width > 0) ? window_width : *w;
+    *dh = (window_height > 0) ? window_height : *h;
+
+    present_scaled = (*dw != *w) || (*dh != *h);
+
+    scale = (float)*dw / *w;
+    if ((float)*dh / *h < scale)
+        scale = (float)*dh / *h;
+
+    present_w = *w * scale;
+    present_h = *h * scale;
+    present_x = (*dw - present_w) / 2;
+    present_y = (*dh - present_h) / 2;
+}
+
 int gfx_graphics_startup(void)
 {
-    int w = 800;
-    int h = 600;
+    int w, h;
+    int dw, dh;
 
     if (!al_is_system_installed())
     {
@@ -146,8 +2033,13 @@ int gfx_graphics_startup(void)
     if (!al_is_font_addon_initialized())
         al_init_font_addon();
 
-    /* Create display */
-    gfx_display = al_create_display(w, h);
+    gfx_build_palette();
+    gfx_choose_sizes(&w, &h, &dw, &dh);
+
+    /* Create display (2 asks the driver to keep vsync off) */
+    al_set_new_display_option(ALLEGRO_VSYNC, vsync_mode ? 1 : 2, ALLEGRO_SUGGEST);
+
+    gfx_display = al_create_display(dw, dh);
     if (!gfx_display)
     {
         fprintf(stderr, "Unable to create Allegro 5 display.\n");
@@ -191,20 +2083,50 @@ int gfx_graphics_startup(void)
     al_set_target_bitmap(gfx_screen);
     al_clear_to_color(al_map_rgb(0, 0, 0));
 
+    clip_tx = 0;
+    clip_ty = 0;
+    clip_bx = w - 1;
+    clip_by = h - 1;
+
     /* Draw scanner frame + border similar to old code */
     if (scanner_image)
     {
         al_draw_bitmap(scanner_image, GFX_X_OFFSET, 385 + GFX_Y_OFFSET, 0);
     }
 
-    /* Top and left/right borders of the 512x384 main area */
-    ALLEGRO_COLOR white = gfx_map_color(GFX_COL_WHITE);
-    al_draw_line(0, 0, 0, 384, white, 1.0f);
-    al_draw_line(0, 0, 511, 0, white, 1.0f);
-    al_draw_line(511, 0, 511, 384, white, 1.0f);
+    /* Top and left/right borders of the area above the console */
+    ALLEGRO_COLOR white = gfx_palette[GFX_COL_WHITE];
+    float bl = GFX_X_OFFSET + gfx_area_left + 0.5f;
+    float bt = GFX_Y_OFFSET + gfx_area_top + 0.5f;
+    float br = bl + gfx_area_w - 1;
+    float bb = bt + gfx_area_h;
+    al_draw_line(bl, bt, bl, bb, white, 1.0f);
+    al_draw_line(bl, bt, br, bt, white, 1.0f);
+    al_draw_line(br, bt, br, bb, white, 1.0f);
 
     gfx_ensure_fonts();
-    last_frame_time = al_get_time();
+    gfx_create_text_cache();
+
+    if (indexed_gfx && gfx_create_index_buffer())
+    {
+        fprintf(stderr, "Unable to create 8-bit screen buffer.\n");
+        return 1;
+    }
+
+    if (depth_buffer_gfx)
+    {
+        depth_buffer = calloc(INDEX_W * INDEX_H, sizeof(float));
+        if (!depth_buffer)
+        {
+            fprintf(stderr, "Unable to create depth buffer.\n");
+            return 1;
+        }
+    }
+
+    gfx_start_job_pool();
+
+    last_frame_time = 0.0;
+    next_frame_time = 0.0;
 
     return 0;
 }
@@ -212,6 +2134,40 @@ int gfx_graphics_startup(void)
 
 void gfx_graphics_shutdown(void)
 {
+    int i;
+#ifdef PACE_DEBUG
+    double mean, jitter, worst;
+
+    if (gfx_frame_stats(&mean, &jitter, &worst) > 0)
+        fprintf(stderr, "Frame time: %.2f ms mean, %.2f ms jitter, %.2f ms worst (last %d frames)\n",
+                mean * 1000.0, jitter * 1000.0, worst * 1000.0, frame_stat_count);
+#endif
+
+    gfx_stop_job_pool();
+    gfx_free_tile_bins();
+    gfx_destroy_index_buffer();
+    gfx_destroy_text_cache();
+    free(depth_buffer);
+    depth_buffer = NULL;
+    gfx_discard_layer();
+
+    for (i = 0; i < WRAP_CACHE_SIZE; i++)
+    {
+        free(wrap_cache[i].txt);
+        wrap_cache[i].txt = NULL;
+    }
+
+    free(poly_queue);
+    free(poly_order);
+    free(poly_sort_tmp);
+    free(poly_points);
+    poly_queue = NULL;
+    poly_order = NULL;
+    poly_sort_tmp = NULL;
+    poly_points = NULL;
+    poly_queue_size = 0;
+    poly_points_size = 0;
+
     if (scanner_image)
     {
         al_destroy_bitmap(scanner_image);
@@ -240,6 +2196,9 @@ void gfx_graphics_shutdown(void)
 
     if (gfx_screen)
     {
+        batch_count = 0;
+        gfx_unlock_screen();
+        screen_acquired = 0;
         al_destroy_bitmap(gfx_screen);
         gfx_screen = NULL;
     }
@@ -250,6 +2209,9 @@ void gfx_graphics_shutdown(void)
         gfx_display = NULL;
     }
 
+    if (font_large == font_small)
+        font_large = NULL;
+
     if (font_small)
     {
         al_destroy_font(font_small);
@@ -268,38 +2230,130 @@ void gfx_graphics_shutdown(void)
  * --------------------------------------------------------------------*/
 
 /*
- * Blit the back buffer to the display, with simple frame cap.
+ * Wait for this frame's deadline and record how long the frame took.
  */
-void gfx_update_screen(void)
+static void gfx_pace_frame(void)
 {
-    double now = al_get_time();
     double frame_len = (speed_cap > 0) ? (speed_cap / 1000.0) : 0.0;
+    double target = next_frame_time;
+    double now = al_get_time();
+
+    if (frame_len > 0)
+    {
+        if (target - now > PACE_SPIN_TIME)
+            al_rest(target - now - PACE_SPIN_TIME);
+
+        while ((now = al_get_time()) < target)
+            ;
 
-    if (frame_len > 0 && (now - last_frame_time) < frame_len)
+        /* More than a frame late: start again from now rather than
+           rushing the next few frames to catch up. */
+        if (now - target > frame_len)
+            target = now;
+
+        next_frame_time = target + frame_len;
+    }
+
+    if (last_frame_time > 0)
     {
-        al_rest(frame_len - (now - last_frame_time));
-        now = al_get_time();
+        frame_times[frame_stat_pos] = now - last_frame_time;
+        frame_stat_pos = (frame_stat_pos + 1) % PACE_STATS;
+        if (frame_stat_count < PACE_STATS)
+            frame_stat_count++;
     }
+
     last_frame_time = now;
+}
+
+/*
+ * Frame time statistics over the last PACE_STATS frames, in seconds.
+ * Jitter is the standard deviation of the frame time.  Returns the
+ * number of frames measured.
+ */
+int gfx_frame_stats(double *mean, double *jitter, double *worst)
+{
+    double sum = 0, sq = 0, max = 0;
+    int i;
+
+    for (i = 0; i < frame_stat_count; i++)
+    {
+        sum += frame_times[i];
+        if (frame_times[i] > max)
+            max = frame_times[i];
+    }
+
+    *mean = frame_stat_count ? (sum / frame_stat_count) : 0;
+
+    for (i = 0; i < frame_stat_count; i++)
+        sq += (frame_times[i] - *mean) * (frame_times[i] - *mean);
+
+    *jitter = frame_stat_count ? sqrt(sq / frame_stat_count) : 0;
+    *worst = max;
+
+    return frame_stat_count;
+}
+
+/*
+ * Blit the back buffer to the display once the frame is due.
+ */
+void gfx_update_screen(void)
+{
+    gfx_pace_frame();
 
     if (!gfx_display || !gfx_screen)
         return;
 
+    gfx_flush_batch();
+
+    if (index_buffer)
+        gfx_present_index_buffer();
+
+    gfx_unlock_screen();
+
+    /* gfx_screen is opaque, so unless it is scaled to a display of
+       another shape it covers the whole backbuffer without clearing
+       it first. */
     al_set_target_backbuffer(gfx_display);
-    al_clear_to_color(al_map_rgb(0, 0, 0));
-    al_draw_bitmap(gfx_screen, 0, 0, 0);
+
+    if (present_scaled)
+    {
+        if (present_x > 0 || present_y > 0)
+            al_clear_to_color(gfx_palette[GFX_COL_BLACK]);
+
+        al_draw_scaled_bitmap(gfx_screen, 0, 0,
+                              al_get_bitmap_width(gfx_screen),
+                              al_get_bitmap_height(gfx_screen),
+                              present_x, present_y, present_w, present_h, 0);
+    }
+    else
+    {
+        al_draw_bitmap(gfx_screen, 0, 0, 0);
+    }
+
     al_flip_display();
 }
 
+/*
+ * Start drawing a frame.  The lock itself is taken by the first pixel
+ * write (or by gfx_clear_display) so that it can be write-only when the
+ * whole view is going to be redrawn.
+ */
 void gfx_acquire_screen(void)
 {
-    if (gfx_screen)
-        al_set_target_bitmap(gfx_screen);
+    if (!gfx_screen)
+        return;
+
+    al_set_target_bitmap(gfx_screen);
+    screen_acquired = 1;
 }
 
 void gfx_release_screen(void)
 {
-    /* Allegro 5 doesn't need explicit release; no-op. */
+    if (!gfx_screen)
+        return;
+
+    gfx_unlock_screen();
+    screen_acquired = 0;
 }
 
 /* ----------------------------------------------------------------------
@@ -309,29 +2363,151 @@ void gfx_release_screen(void)
 void gfx_fast_plot_pixel(int x, int y, int col)
 {
     if (!gfx_screen) return;
-    al_set_target_bitmap(gfx_screen);
-    al_put_pixel(x, y, gfx_map_color(col));
+    if (gfx_indexed(y))
+    {
+        sw_pixel(&index_surface, x, y, col);
+        return;
+    }
+    if (gfx_put_locked_pixel(x, y, col))
+        return;
+    gfx_batch_point(x, y, col);
+}
+
+/*
+ * A row of len pixels starting at (x, y) in screen coordinates, with
+ * the palette index of each in cols.  The textured planet is drawn a
+ * row at a time like this.
+ */
+void gfx_draw_span(int x, int y, int len, const unsigned char *cols)
+{
+    int i;
+
+    if (!gfx_screen || len <= 0) return;
+    if (gfx_indexed(y))
+    {
+        sw_span(&index_surface, x, y, len, cols);
+        return;
+    }
+
+    if (screen_acquired &&
+        x >= LOCK_TX && x + len - 1 <= LOCK_BX && y >= LOCK_TY && y <= LOCK_BY)
+    {
+        gfx_lock_screen(ALLEGRO_LOCK_READWRITE);
+        if (screen_lock)
+        {
+            sw_span(&lock_surface, x, y, len, cols);
+            return;
+        }
+    }
+
+    for (i = 0; i < len; i++)
+        gfx_fast_plot_pixel(x + i, y, cols[i]);
 }
 
 void gfx_plot_pixel(int x, int y, int col)
 {
     if (!gfx_screen) return;
-    al_set_target_bitmap(gfx_screen);
-    al_put_pixel(x + GFX_X_OFFSET, y + GFX_Y_OFFSET, gfx_map_color(col));
+    x += GFX_X_OFFSET;
+    y += GFX_Y_OFFSET;
+    if (gfx_indexed(y))
+    {
+        sw_pixel(&index_surface, x, y, col);
+        return;
+    }
+    if (gfx_put_locked_pixel(x, y, col))
+        return;
+    gfx_batch_point(x, y, col);
+}
+
+/*
+ * Explosion particles: blocks of w[i] by h[i] pixels with their top
+ * left corners at x[i], y[i].  They are written straight into the index
+ * buffer or the locked screen when those are in use, and otherwise all
+ * go into the primitive batch together.
+ */
+void gfx_draw_particles(int count, const int *x, const int *y,
+                        const unsigned char *w, const unsigned char *h, int col)
+{
+    int i;
+    int tx, ty, bx, by;
+
+    if (!gfx_screen) return;
+
+    for (i = 0; i < count; i++)
+    {
+        tx = x[i] + GFX_X_OFFSET;
+        ty = y[i] + GFX_Y_OFFSET;
+        bx = tx + w[i] - 1;
+        by = ty + h[i] - 1;
+
+        if (bx < clip_tx || tx > clip_bx || by < clip_ty || ty > clip_by)
+            continue;
+
+        if (gfx_indexed(ty))
+        {
+            sw_rect(&index_surface, tx, ty, bx, by, col);
+            continue;
+        }
+
+        if (screen_acquired && tx >= LOCK_TX && bx <= LOCK_BX &&
+            ty >= LOCK_TY && by <= LOCK_BY)
+        {
+            gfx_lock_screen(ALLEGRO_LOCK_READWRITE);
+            if (screen_lock)
+            {
+                sw_rect(&lock_surface, tx, ty, bx, by, col);
+                continue;
+            }
+        }
+
+        gfx_batch_rectangle(tx, ty, bx + 1, by + 1, col);
+    }
 }
 
 void gfx_draw_filled_circle(int cx, int cy, int radius, int circle_colour)
 {
     if (!gfx_screen) return;
-    al_set_target_bitmap(gfx_screen);
+    if (gfx_indexed(cy - radius + GFX_Y_OFFSET))
+    {
+        sw_circle(&index_surface, cx + GFX_X_OFFSET, cy + GFX_Y_OFFSET,
+                  radius, circle_colour, 1);
+        return;
+    }
+    gfx_target_screen();
     al_draw_filled_circle(cx + GFX_X_OFFSET,
                           cy + GFX_Y_OFFSET,
                           (float)radius,
-                          gfx_map_color(circle_colour));
+                          gfx_palette[circle_colour]);
+}
+
+/*
+ * All the line routines end up here.  aa asks for an anti-aliased line,
+ * which is only drawn when the line is batched and is neither flat nor
+ * upright.
+ */
+static void gfx_line(int x1, int y1, int x2, int y2, int col, int aa)
+{
+    if (!gfx_screen) return;
+
+    x1 += GFX_X_OFFSET;
+    y1 += GFX_Y_OFFSET;
+    x2 += GFX_X_OFFSET;
+    y2 += GFX_Y_OFFSET;
+
+    if (gfx_indexed((y1 < y2) ? y1 : y2))
+    {
+        sw_line(&index_surface, x1, y1, x2, y2, col);
+        return;
+    }
+
+    if (aa && x1 != x2 && y1 != y2)
+        gfx_batch_aa_line(x1, y1, x2, y2, col);
+    else
+        gfx_batch_line(x1, y1, x2, y2, col);
 }
 
-/* We drop the original custom AA implementation and just degrade to normal
- * circle/line draw. The AA functions still exist for API compatibility. */
+/* We drop the original custom AA circle and just degrade to a normal
+ * circle.  AA lines are drawn by gfx_batch_aa_line(). */
 
 void gfx_draw_aa_circle(int cx, int cy, int radius_fixed)
 {
@@ -345,15 +2521,21 @@ void gfx_draw_aa_line(int x1_fixed, int y1_fixed, int x2_fixed, int y2_fixed)
     int y1 = y1_fixed >> 16;
     int x2 = x2_fixed >> 16;
     int y2 = y2_fixed >> 16;
-    gfx_draw_colour_line(x1, y1, x2, y2, GFX_COL_WHITE);
+    gfx_line(x1, y1, x2, y2, GFX_COL_WHITE, 1);
 }
 
 void gfx_draw_circle(int cx, int cy, int radius, int circle_colour)
 {
     if (!gfx_screen) return;
-    al_set_target_bitmap(gfx_screen);
+    if (gfx_indexed(cy - radius + GFX_Y_OFFSET))
+    {
+        sw_circle(&index_surface, cx + GFX_X_OFFSET, cy + GFX_Y_OFFSET,
+                  radius, circle_colour, 0);
+        return;
+    }
+    gfx_target_screen();
 
-    ALLEGRO_COLOR col = gfx_map_color(circle_colour);
+    ALLEGRO_COLOR col = gfx_palette[circle_colour];
 
     al_draw_circle(cx + GFX_X_OFFSET,
                    cy + GFX_Y_OFFSET,
@@ -364,118 +2546,117 @@ void gfx_draw_circle(int cx, int cy, int radius, int circle_colour)
 
 void gfx_draw_line(int x1, int y1, int x2, int y2)
 {
-    if (!gfx_screen) return;
-    al_set_target_bitmap(gfx_screen);
-
-    ALLEGRO_COLOR col = gfx_map_color(GFX_COL_WHITE);
-
-    if (y1 == y2)
-    {
-        al_draw_line(x1 + GFX_X_OFFSET, y1 + GFX_Y_OFFSET,
-                     x2 + GFX_X_OFFSET, y2 + GFX_Y_OFFSET, col, 1.0f);
-        return;
-    }
-
-    if (x1 == x2)
-    {
-        al_draw_line(x1 + GFX_X_OFFSET, y1 + GFX_Y_OFFSET,
-                     x2 + GFX_X_OFFSET, y2 + GFX_Y_OFFSET, col, 1.0f);
-        return;
-    }
-
-    if (anti_alias_gfx)
-        gfx_draw_aa_line(x1 << 16, y1 << 16, x2 << 16, y2 << 16);
-    else
-        al_draw_line(x1 + GFX_X_OFFSET, y1 + GFX_Y_OFFSET,
-                     x2 + GFX_X_OFFSET, y2 + GFX_Y_OFFSET, col, 1.0f);
+    gfx_line(x1, y1, x2, y2, GFX_COL_WHITE, anti_alias_gfx);
 }
 
 void gfx_draw_colour_line(int x1, int y1, int x2, int y2, int line_colour)
 {
+    gfx_line(x1, y1, x2, y2, line_colour,
+             anti_alias_gfx && (line_colour == GFX_COL_WHITE));
+}
+
+void gfx_draw_triangle(int x1, int y1, int x2, int y2, int x3, int y3, int col)
+{
+    int pts[6];
+
     if (!gfx_screen) return;
-    al_set_target_bitmap(gfx_screen);
 
-    ALLEGRO_COLOR col = gfx_map_color(line_colour);
+    pts[0] = x1 + GFX_X_OFFSET;
+    pts[1] = y1 + GFX_Y_OFFSET;
+    pts[2] = x2 + GFX_X_OFFSET;
+    pts[3] = y2 + GFX_Y_OFFSET;
+    pts[4] = x3 + GFX_X_OFFSET;
+    pts[5] = y3 + GFX_Y_OFFSET;
 
-    if (y1 == y2 || x1 == x2)
+    if (gfx_indexed(GFX_Y_OFFSET + ((y1 < y2) ? ((y1 < y3) ? y1 : y3) : ((y2 < y3) ? y2 : y3))))
     {
-        al_draw_line(x1 + GFX_X_OFFSET, y1 + GFX_Y_OFFSET,
-                     x2 + GFX_X_OFFSET, y2 + GFX_Y_OFFSET, col, 1.0f);
+        sw_convex_polygon(&index_surface, 3, pts, NULL, col);
         return;
     }
 
-    if (anti_alias_gfx && (line_colour == GFX_COL_WHITE))
-        gfx_draw_aa_line(x1 << 16, y1 << 16, x2 << 16, y2 << 16);
-    else
-        al_draw_line(x1 + GFX_X_OFFSET, y1 + GFX_Y_OFFSET,
-                     x2 + GFX_X_OFFSET, y2 + GFX_Y_OFFSET, col, 1.0f);
+    gfx_batch_triangle(pts[0], pts[1], pts[2], pts[3], pts[4], pts[5], col);
 }
 
-void gfx_draw_triangle(int x1, int y1, int x2, int y2, int x3, int y3, int col)
+/* ----------------------------------------------------------------------
+ * Text
+ * --------------------------------------------------------------------*/
+
+/*
+ * Draw a string at screen coordinates, into the index buffer if it is in
+ * use.  The builtin font is 8 pixels a character, so centring is exact.
+ */
+static void gfx_text_out(ALLEGRO_FONT *font, int x, int y, const char *txt,
+                         int col, int flags)
 {
-    if (!gfx_screen) return;
-    al_set_target_bitmap(gfx_screen);
+    float fx;
+    int slot;
+
+    if (gfx_indexed(y))
+    {
+        if (flags & ALLEGRO_ALIGN_CENTRE)
+            x -= (int)strlen(txt) * 4;
+        sw_text(&index_surface, x, y, txt, col);
+        return;
+    }
 
-    ALLEGRO_COLOR c = gfx_map_color(col);
+    slot = gfx_text_slot(font, txt, col);
+    if (slot >= 0)
+    {
+        fx = (float)x;
+        if (flags & ALLEGRO_ALIGN_CENTRE)
+            fx -= text_slots[slot].width / 2.0f;
+
+        gfx_batch_bitmap();
+        al_draw_bitmap_region(text_atlas, 0, slot * TEXT_SLOT_H,
+                              text_slots[slot].width, TEXT_SLOT_H,
+                              fx, (float)y, 0);
+        return;
+    }
 
-    al_draw_filled_triangle(
-        x1 + GFX_X_OFFSET, y1 + GFX_Y_OFFSET,
-        x2 + GFX_X_OFFSET, y2 + GFX_Y_OFFSET,
-        x3 + GFX_X_OFFSET, y3 + GFX_Y_OFFSET,
-        c
-    );
+    gfx_target_screen();
+    al_draw_text(font, gfx_palette[col], (float)x, (float)y, flags, txt);
 }
 
-/* ----------------------------------------------------------------------
- * Text
- * --------------------------------------------------------------------*/
-
 void gfx_display_text(int x, int y, char *txt)
 {
     if (!gfx_screen) return;
     gfx_ensure_fonts();
-    al_set_target_bitmap(gfx_screen);
-
-    ALLEGRO_COLOR col = gfx_map_color(GFX_COL_WHITE);
-    float fx = (float)((x / (2 / GFX_SCALE)) + GFX_X_OFFSET);
-    float fy = (float)((y / (2 / GFX_SCALE)) + GFX_Y_OFFSET);
 
-    al_draw_text(font_small, col, fx, fy, 0, txt);
+    gfx_text_out(font_small,
+                 (x / (2 / GFX_SCALE)) + GFX_X_OFFSET,
+                 (y / (2 / GFX_SCALE)) + GFX_Y_OFFSET,
+                 txt, GFX_COL_WHITE, 0);
 }
 
 void gfx_display_colour_text(int x, int y, char *txt, int col)
 {
     if (!gfx_screen) return;
     gfx_ensure_fonts();
-    al_set_target_bitmap(gfx_screen);
-
-    ALLEGRO_COLOR c = gfx_map_color(col);
-    float fx = (float)((x / (2 / GFX_SCALE)) + GFX_X_OFFSET);
-    float fy = (float)((y / (2 / GFX_SCALE)) + GFX_Y_OFFSET);
 
-    al_draw_text(font_small, c, fx, fy, 0, txt);
+    gfx_text_out(font_small,
+                 (x / (2 / GFX_SCALE)) + GFX_X_OFFSET,
+                 (y / (2 / GFX_SCALE)) + GFX_Y_OFFSET,
+                 txt, col, 0);
 }
 
 void gfx_display_centre_text(int y, char *str, int psize, int col)
 {
     if (!gfx_screen) return;
     gfx_ensure_fonts();
-    al_set_target_bitmap(gfx_screen);
 
     ALLEGRO_FONT *font = font_small;
-    ALLEGRO_COLOR c = gfx_map_color(col);
 
     if (psize == 140)
     {
         /* mimic "bigger" text: still built-in, just same font now */
         font = font_large ? font_large : font_small;
-        c = gfx_map_color(GFX_COL_WHITE);
+        col = GFX_COL_WHITE;
     }
 
-    float cx = (float)((128 * GFX_SCALE) + GFX_X_OFFSET);
-    float cy = (float)((y / (2 / GFX_SCALE)) + GFX_Y_OFFSET);
-
-    al_draw_text(font, c, cx, cy, ALLEGRO_ALIGN_CENTRE, str);
+    gfx_text_out(font,
+                 (128 * GFX_SCALE) + GFX_X_OFFSET,
+                 (y / (2 / GFX_SCALE)) + GFX_Y_OFFSET,
+                 str, col, ALLEGRO_ALIGN_CENTRE);
 }
 
 /* ----------------------------------------------------------------------
@@ -484,42 +2665,78 @@ void gfx_display_centre_text(int y, char *str, int psize, int col)
 
 void gfx_clear_display(void)
 {
+    int tx, ty, bx, by;
+
     if (!gfx_screen) return;
-    al_set_target_bitmap(gfx_screen);
-    al_draw_filled_rectangle(GFX_X_OFFSET + 1, GFX_Y_OFFSET + 1,
-                             510 + GFX_X_OFFSET, 383 + GFX_Y_OFFSET,
-                             gfx_map_color(GFX_COL_BLACK));
+
+    if (index_buffer)
+    {
+        sw_rect(&index_surface, LOCK_TX, LOCK_TY,
+                LOCK_BX, LOCK_BY, GFX_COL_BLACK);
+        return;
+    }
+
+    if (screen_acquired)
+    {
+        tx = (clip_tx > LOCK_TX) ? clip_tx : LOCK_TX;
+        ty = (clip_ty > LOCK_TY) ? clip_ty : LOCK_TY;
+        bx = (clip_bx < LOCK_BX) ? clip_bx : LOCK_BX;
+        by = (clip_by < LOCK_BY) ? clip_by : LOCK_BY;
+
+        /* Write-only is only safe if every locked pixel gets written. */
+        if (tx == LOCK_TX && ty == LOCK_TY && bx == LOCK_BX && by == LOCK_BY)
+            gfx_lock_screen(ALLEGRO_LOCK_WRITEONLY);
+        else
+            gfx_lock_screen(ALLEGRO_LOCK_READWRITE);
+
+        if (screen_lock)
+        {
+            sw_rect(&lock_surface, tx, ty, bx, by, GFX_COL_BLACK);
+            return;
+        }
+    }
+
+    gfx_batch_rectangle(LOCK_TX, LOCK_TY,
+                        LOCK_BX, LOCK_BY, GFX_COL_BLACK);
 }
 
 void gfx_clear_text_area(void)
 {
     if (!gfx_screen) return;
-    al_set_target_bitmap(gfx_screen);
-    al_draw_filled_rectangle(GFX_X_OFFSET + 1, GFX_Y_OFFSET + 340,
-                             510 + GFX_X_OFFSET, 383 + GFX_Y_OFFSET,
-                             gfx_map_color(GFX_COL_BLACK));
+    if (index_buffer)
+    {
+        sw_rect(&index_surface, LOCK_TX, GFX_Y_OFFSET + 340,
+                LOCK_BX, LOCK_BY, GFX_COL_BLACK);
+        return;
+    }
+    gfx_batch_rectangle(LOCK_TX, GFX_Y_OFFSET + 340,
+                        LOCK_BX, LOCK_BY, GFX_COL_BLACK);
 }
 
 void gfx_clear_area(int tx, int ty, int bx, int by)
 {
     if (!gfx_screen) return;
-    al_set_target_bitmap(gfx_screen);
-    al_draw_filled_rectangle(tx + GFX_X_OFFSET,
-                             ty + GFX_Y_OFFSET,
-                             bx + GFX_X_OFFSET,
-                             by + GFX_Y_OFFSET,
-                             gfx_map_color(GFX_COL_BLACK));
+    if (gfx_indexed(ty + GFX_Y_OFFSET))
+    {
+        sw_rect(&index_surface, tx + GFX_X_OFFSET, ty + GFX_Y_OFFSET,
+                bx + GFX_X_OFFSET, by + GFX_Y_OFFSET, GFX_COL_BLACK);
+        return;
+    }
+    gfx_batch_rectangle(tx + GFX_X_OFFSET, ty + GFX_Y_OFFSET,
+                        bx + GFX_X_OFFSET, by + GFX_Y_OFFSET, GFX_COL_BLACK);
 }
 
 void gfx_draw_rectangle(int tx, int ty, int bx, int by, int col)
 {
     if (!gfx_screen) return;
-    al_set_target_bitmap(gfx_screen);
-    al_draw_filled_rectangle(tx + GFX_X_OFFSET,
-                             ty + GFX_Y_OFFSET,
-                             bx + GFX_X_OFFSET,
-                             by + GFX_Y_OFFSET,
-                             gfx_map_color(col));
+    if (gfx_indexed(ty + GFX_Y_OFFSET))
+    {
+        sw_rect(&index_surface, tx + GFX_X_OFFSET, ty + GFX_Y_OFFSET,
+                bx + GFX_X_OFFSET, by + GFX_Y_OFFSET, col);
+        return;
+    }
+    gfx_batch_rectangle(tx + GFX_X_OFFSET, ty + GFX_Y_OFFSET,
+                        bx + GFX_X_OFFSET, by + GFX_Y_OFFSET, col);
 }
 
 /* ----------------------------------------------------------------------
@@ -528,41 +2745,19 @@ void gfx_draw_rectangle(int tx, int ty, int bx, int by, int col)
 
 void gfx_display_pretty_text(int tx, int ty, int bx, int by, char *txt)
 {
+    struct wrap_entry *we;
+    int i;
+
     if (!gfx_screen) return;
     gfx_ensure_fonts();
-    al_set_target_bitmap(gfx_screen);
-
-    char strbuf[100];
-    char *str = txt;
-    char *bptr;
-    int len = (int)strlen(txt);
-    int pos;
-    int maxlen;
 
     /* very approximate: assume 8px per char like old font */
-    maxlen = (bx - tx) / 8;
+    we = gfx_wrap_text(txt, (bx - tx) / 8);
 
-    while (len > 0)
+    for (i = 0; i < we->num_lines; i++)
     {
-        pos = maxlen;
-        if (pos > len)
-            pos = len;
-
-        while ((str[pos] != ' ') && (str[pos] != ',') &&
-               (str[pos] != '.') && (str[pos] != '\0') && pos > 0)
-        {
-            pos--;
-        }
-
-        len = len - pos - 1;
-
-        for (bptr = strbuf; pos >= 0; pos--)
-            *bptr++ = *str++;
-
-        *bptr = '\0';
-
-        al_draw_text(font_small, gfx_map_color(GFX_COL_WHITE),
-                     tx + GFX_X_OFFSET, ty + GFX_Y_OFFSET, 0, strbuf);
+        gfx_text_out(font_small, tx + GFX_X_OFFSET, ty + GFX_Y_OFFSET,
+                     we->lines[i], GFX_COL_WHITE, 0);
         ty += (8 * GFX_SCALE);
     }
 }
@@ -574,77 +2769,320 @@ void gfx_display_pretty_text(int tx, int ty, int bx, int by, char *txt)
 void gfx_draw_scanner(void)
 {
     if (!gfx_screen || !scanner_image) return;
-    al_set_target_bitmap(gfx_screen);
+    gfx_target_screen();
     al_draw_bitmap(scanner_image, GFX_X_OFFSET, 385 + GFX_Y_OFFSET, 0);
 }
 
+/*
+ * Copy part of the scanner bitmap back onto the console, erasing
+ * whatever was drawn over it.  Coordinates are inclusive and may stray
+ * outside the console; only the console part is restored.
+ */
+void gfx_draw_scanner_area(int tx, int ty, int bx, int by)
+{
+    int w, h;
+
+    if (!gfx_screen || !scanner_image) return;
+
+    w = al_get_bitmap_width(scanner_image);
+    h = al_get_bitmap_height(scanner_image);
+
+    if (tx < 0) tx = 0;
+    if (ty < 385) ty = 385;
+    if (bx > w - 1) bx = w - 1;
+    if (by > 385 + h - 1) by = 385 + h - 1;
+
+    if (tx > bx || ty > by)
+        return;
+
+    gfx_batch_bitmap();
+    al_draw_bitmap_region(scanner_image, tx, ty - 385, bx - tx + 1, by - ty + 1,
+                          tx + GFX_X_OFFSET, ty + GFX_Y_OFFSET, 0);
+}
+
+/* ----------------------------------------------------------------------
+ * Retained layer
+ * --------------------------------------------------------------------*/
+
+/*
+ * Save the given part of the view so gfx_restore_layer() can put it
+ * back.  Only one layer is kept; saving again replaces it.
+ */
+void gfx_save_layer(int tx, int ty, int bx, int by)
+{
+    int w, h, y;
+
+    if (!gfx_screen) return;
+
+    gfx_discard_layer();
+
+    tx += GFX_X_OFFSET;
+    ty += GFX_Y_OFFSET;
+    bx += GFX_X_OFFSET;
+    by += GFX_Y_OFFSET;
+    w = bx - tx + 1;
+    h = by - ty + 1;
+
+    if (index_buffer)
+    {
+        if (tx < index_surface.tx || bx > index_surface.bx ||
+            ty < index_surface.ty || by > index_surface.by)
+            return;
+
+        layer_index = malloc(w * h);
+        if (!layer_index)
+            return;
+
+        for (y = 0; y < h; y++)
+            memcpy(layer_index + y * w,
+                   index_buffer + (ty + y - index_surface.ty) * INDEX_W + (tx - index_surface.tx),
+                   w);
+    }
+    else
+    {
+        gfx_flush_batch();
+        gfx_unlock_screen();
+
+        layer_bitmap = al_create_bitmap(w, h);
+        if (!layer_bitmap)
+            return;
+
+        al_set_target_bitmap(layer_bitmap);
+        al_draw_bitmap_region(gfx_screen, tx, ty, w, h, 0, 0, 0);
+        al_set_target_bitmap(gfx_screen);
+    }
+
+    layer_tx = tx;
+    layer_ty = ty;
+    layer_bx = bx;
+    layer_by = by;
+}
+
+/*
+ * Copy the saved layer back onto the screen.  Returns 0 if there is
+ * no layer, in which case the caller has to redraw from scratch.
+ */
+int gfx_restore_layer(void)
+{
+    int w, y;
+
+    if (!gfx_screen) return 0;
+
+    if (layer_index && index_buffer)
+    {
+        w = layer_bx - layer_tx + 1;
+        for (y = layer_ty; y <= layer_by; y++)
+            memcpy(index_buffer + (y - index_surface.ty) * INDEX_W + (layer_tx - index_surface.tx),
+                   layer_index + (y - layer_ty) * w, w);
+        return 1;
+    }
+
+    if (layer_bitmap)
+    {
+        gfx_target_screen();
+        al_draw_bitmap(layer_bitmap, layer_tx, layer_ty, 0);
+        return 1;
+    }
+
+    return 0;
+}
+
+void gfx_discard_layer(void)
+{
+    if (layer_bitmap)
+        al_destroy_bitmap(layer_bitmap);
+    free(layer_index);
+    layer_bitmap = NULL;
+    layer_index = NULL;
+}
+
 /* ----------------------------------------------------------------------
  * Clip region
  * --------------------------------------------------------------------*/
 
+/* Set the clip rectangle in screen coordinates. */
+static void gfx_set_screen_clip(int tx, int ty, int bx, int by)
+{
+    if (tx == clip_tx && ty == clip_ty && bx == clip_bx && by == clip_by)
+        return;
+
+    clip_tx = tx;
+    clip_ty = ty;
+    clip_bx = bx;
+    clip_by = by;
+
+    gfx_flush_batch();
+    al_set_target_bitmap(gfx_screen);
+    al_set_clipping_rectangle(tx, ty, bx - tx + 1, by - ty + 1);
+}
+
 void gfx_set_clip_region(int tx, int ty, int bx, int by)
 {
     if (!gfx_screen) return;
-    al_set_target_bitmap(gfx_screen);
-    al_set_clipping_rectangle(tx + GFX_X_OFFSET,
-                              ty + GFX_Y_OFFSET,
-                              bx - tx + 1,
-                              by - ty + 1);
+
+    gfx_set_screen_clip(tx + GFX_X_OFFSET, ty + GFX_Y_OFFSET,
+                        bx + GFX_X_OFFSET, by + GFX_Y_OFFSET);
+}
+
+/*
+ * Cut the clip rectangle down to the space view, for when the view is
+ * smaller than the area above the console.
+ */
+void gfx_clip_to_view(void)
+{
+    int tx, ty, bx, by;
+
+    if (!gfx_screen) return;
+
+    tx = GFX_X_OFFSET + GFX_VIEW_LEFT + 1;
+    ty = GFX_Y_OFFSET + GFX_VIEW_TOP + 1;
+    bx = GFX_X_OFFSET + GFX_VIEW_LEFT + GFX_VIEW_W - 2;
+    by = GFX_Y_OFFSET + GFX_VIEW_TOP + GFX_VIEW_H - 1;
+
+    gfx_set_screen_clip((clip_tx > tx) ? clip_tx : tx, (clip_ty > ty) ? clip_ty : ty,
+                        (clip_bx < bx) ? clip_bx : bx, (clip_by < by) ? clip_by : by);
 }
 
 /* ----------------------------------------------------------------------
  * Polygon rendering / sorting
  * --------------------------------------------------------------------*/
 
+/*
+ * Ships are drawn between gfx_start_render() and gfx_finish_render()
+ * with the clip rectangle cut down to the view; it is put back after.
+ */
+static int render_clip[4];
+
 void gfx_start_render(void)
 {
-    start_poly = 0;
     total_polys = 0;
+    total_points = 0;
+
+    render_clip[0] = clip_tx;
+    render_clip[1] = clip_ty;
+    render_clip[2] = clip_bx;
+    render_clip[3] = clip_by;
+    gfx_clip_to_view();
+
+    if (depth_buffer && depth_by >= depth_ty)
+    {
+        memset(depth_buffer + depth_ty * INDEX_W, 0,
+               (depth_by - depth_ty + 1) * INDEX_W * sizeof(float));
+        depth_ty = INDEX_H;
+        depth_by = -1;
+    }
+}
+
+/* Grow the polygon arena to hold at least n polygons and p point values. */
+static int gfx_grow_poly_arena(int n, int p)
+{
+    void *mem;
+    int size;
+
+    if (n > poly_queue_size)
+    {
+        size = poly_queue_size ? poly_queue_size * 2 : 256;
+        while (size < n)
+            size *= 2;
+
+        mem = realloc(poly_queue, size * sizeof(*poly_queue));
+        if (!mem)
+            return 0;
+        poly_queue = mem;
+
+        mem = realloc(poly_order, size * sizeof(int));
+        if (!mem)
+            return 0;
+        poly_order = mem;
+
+        mem = realloc(poly_sort_tmp, size * sizeof(int));
+        if (!mem)
+            return 0;
+        poly_sort_tmp = mem;
+
+        poly_queue_size = size;
+    }
+
+    if (p > poly_points_size)
+    {
+        size = poly_points_size ? poly_points_size * 2 : 4096;
+        while (size < p)
+            size *= 2;
+
+        mem = realloc(poly_points, size * sizeof(int));
+        if (!mem)
+            return 0;
+        poly_points = mem;
+        poly_points_size = size;
+    }
+
+    return 1;
 }
 
 void gfx_render_polygon(int num_points, int *point_list, int face_colour, int zavg)
 {
-    int i;
-    int x;
-    int nx;
+    struct poly_data *poly;
 
-    if (total_polys == MAX_POLYS)
+    if (!gfx_grow_poly_arena(total_polys + 1, total_points + num_points * 2))
         return;
 
-    x = total_polys;
-    total_polys++;
+    poly = &poly_queue[total_polys];
+    poly->no_points = num_points;
+    poly->face_colour = face_colour;
+    poly->first_point = total_points;
 
-    poly_chain[x].no_points = num_points;
-    poly_chain[x].face_colour = face_colour;
-    poly_chain[x].z = zavg;
-    poly_chain[x].next = -1;
+    /* Flip the sign bit to make the order unsigned, then invert so
+       that larger z (further away) sorts first. */
+    poly->key = ~((unsigned int)zavg ^ 0x80000000u);
 
-    for (i = 0; i < 16; i++)
-        poly_chain[x].point_list[i] = point_list[i];
+    memcpy(&poly_points[total_points], point_list, num_points * 2 * sizeof(int));
 
-    if (x == 0)
-        return;
+    poly_order[total_polys] = total_polys;
+    total_polys++;
+    total_points += num_points * 2;
+}
 
-    if (zavg > poly_chain[start_poly].z)
-    {
-        poly_chain[x].next = start_poly;
-        start_poly = x;
-        return;
-    }
+/*
+ * Order the queued polygons furthest first.  This is an LSD radix sort a
+ * byte at a time, so it is linear in the number of polygons and stable:
+ * polygons at the same depth are drawn in the order they were queued.
+ * Passes where every key has the same byte are skipped.
+ */
+static void gfx_sort_polys(void)
+{
+    int count[256];
+    int *src = poly_order;
+    int *dst = poly_sort_tmp;
+    int *t;
+    int shift, i, b, sum, n;
 
-    for (i = start_poly; poly_chain[i].next != -1; i = poly_chain[i].next)
+    for (shift = 0; shift < 32; shift += 8)
     {
-        nx = poly_chain[i].next;
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < total_polys; i++)
+            count[(poly_queue[src[i]].key >> shift) & 255]++;
+
+        if (count[(poly_queue[src[0]].key >> shift) & 255] == total_polys)
+            continue;
 
-        if (zavg > poly_chain[nx].z)
+        sum = 0;
+        for (b = 0; b < 256; b++)
         {
-            poly_chain[i].next = x;
-            poly_chain[x].next = nx;
-            return;
+            n = count[b];
+            count[b] = sum;
+            sum += n;
         }
+
+        for (i = 0; i < total_polys; i++)
+            dst[count[(poly_queue[src[i]].key >> shift) & 255]++] = src[i];
+
+        t = src;
+        src = dst;
+        dst = t;
     }
 
-    poly_chain[i].next = x;
+    if (src != poly_order)
+        memcpy(poly_order, src, total_polys * sizeof(int));
 }
 
 void gfx_render_line(int x1, int y1, int x2, int y2, int dist, int col)
@@ -659,35 +3097,111 @@ void gfx_render_line(int x1, int y1, int x2, int y2, int dist, int col)
     gfx_render_polygon(2, point_list, col, dist);
 }
 
+/*
+ * Where polygons can be filled in software: the index buffer, or the
+ * screen if it has been acquired (locking it if need be).  NULL means
+ * they have to go through Allegro.
+ */
+static struct gfx_surface *gfx_polygon_surface(int y)
+{
+    if (gfx_indexed(y))
+        return &index_surface;
+
+    if (!index_buffer && screen_acquired)
+    {
+        gfx_lock_screen(ALLEGRO_LOCK_READWRITE);
+        if (screen_lock)
+            return &lock_surface;
+    }
+
+    return NULL;
+}
+
 void gfx_polygon(int num_points, int *poly_list, int face_colour)
 {
+    struct gfx_surface *surf;
+    int spts[32];
+    int ymin;
+    int i;
+
     if (!gfx_screen) return;
-    al_set_target_bitmap(gfx_screen);
+    if (num_points < 3 || num_points > 16)
+        return;
+
+    ymin = poly_list[1];
+    for (i = 0; i < num_points * 2; i += 2)
+    {
+        spts[i] = poly_list[i] + GFX_X_OFFSET;
+        spts[i + 1] = poly_list[i + 1] + GFX_Y_OFFSET;
+        if (spts[i + 1] < ymin)
+            ymin = spts[i + 1];
+    }
+
+    surf = gfx_polygon_surface(ymin);
+    if (surf)
+    {
+        sw_convex_polygon(surf, num_points, spts, NULL, face_colour);
+        return;
+    }
 
-    ALLEGRO_COLOR col = gfx_map_color(face_colour);
+    /* Ship faces are convex, so they go into the batch as a fan. */
+    for (i = 2; i < num_points; i++)
+    {
+        gfx_batch_triangle(spts[0], spts[1],
+                           spts[i * 2 - 2], spts[i * 2 - 1],
+                           spts[i * 2], spts[i * 2 + 1],
+                           face_colour);
+    }
+}
 
-    float pts[32]; /* up to 16 points * 2 */
+/*
+ * A solid face for the depth buffer.  depth gives 1/z across the face as
+ * a * x + b * y + c in game coordinates.  Without a depth buffer, or a
+ * surface to fill it into, the face is queued for sorting by zavg.
+ */
+void gfx_render_depth_polygon(int num_points, int *point_list, const double *depth,
+                              int face_colour, int zavg)
+{
+    struct gfx_surface *surf;
+    int spts[32];
+    float plane[3];
+    int ymin;
     int i;
-    int x = 0;
-    int y = 1;
 
-    for (i = 0; i < num_points; i++)
+    if (!gfx_screen) return;
+
+    if (!depth_buffer || !depth || num_points < 3 || num_points > 16)
     {
-        int px = poly_list[x] + GFX_X_OFFSET;
-        int py = poly_list[y] + GFX_Y_OFFSET;
+        gfx_render_polygon(num_points, point_list, face_colour, zavg);
+        return;
+    }
 
-        pts[i * 2 + 0] = (float)px;
-        pts[i * 2 + 1] = (float)py;
+    ymin = point_list[1] + GFX_Y_OFFSET;
+    for (i = 0; i < num_points * 2; i += 2)
+    {
+        spts[i] = point_list[i] + GFX_X_OFFSET;
+        spts[i + 1] = point_list[i + 1] + GFX_Y_OFFSET;
+        if (spts[i + 1] < ymin)
+            ymin = spts[i + 1];
+    }
 
-        x += 2;
-        y += 2;
+    surf = gfx_polygon_surface(ymin);
+    if (!surf)
+    {
+        gfx_render_polygon(num_points, point_list, face_colour, zavg);
+        return;
     }
 
-    al_draw_filled_polygon(pts, num_points, col);
+    plane[0] = depth[0];
+    plane[1] = depth[1];
+    plane[2] = depth[2] - depth[0] * GFX_X_OFFSET - depth[1] * GFX_Y_OFFSET;
+
+    sw_convex_polygon(surf, num_points, spts, plane, face_colour);
 }
 
-void gfx_finish_render(void)
+static void gfx_render_queue(void)
 {
+    struct gfx_surface *surf;
     int num_points;
     int *pl;
     int i;
@@ -696,15 +3210,32 @@ void gfx_finish_render(void)
     if (total_polys == 0)
         return;
 
-    for (i = start_poly; i != -1; i = poly_chain[i].next)
+    gfx_sort_polys();
+
+    if (num_job_workers > 0 && total_polys >= TILE_MIN_POLYS)
+    {
+        surf = gfx_polygon_surface(LOCK_TY);
+        if (surf && gfx_bin_polys())
+        {
+            gfx_run_parallel(gfx_render_tile, TILES_X * TILES_Y, surf);
+            return;
+        }
+    }
+
+    for (i = 0; i < total_polys; i++)
     {
-        num_points = poly_chain[i].no_points;
-        pl = poly_chain[i].point_list;
-        col = poly_chain[i].face_colour;
+        num_points = poly_queue[poly_order[i]].no_points;
+        pl = &poly_points[poly_queue[poly_order[i]].first_point];
+        col = poly_queue[poly_order[i]].face_colour;
 
         if (num_points == 2)
         {
-            gfx_draw_colour_line(pl[0], pl[1], pl[2], pl[3], col);
+            surf = gfx_polygon_surface(((pl[1] < pl[3]) ? pl[1] : pl[3]) + GFX_Y_OFFSET);
+            if (surf)
+                sw_line(surf, pl[0] + GFX_X_OFFSET, pl[1] + GFX_Y_OFFSET,
+                        pl[2] + GFX_X_OFFSET, pl[3] + GFX_Y_OFFSET, col);
+            else
+                gfx_draw_colour_line(pl[0], pl[1], pl[2], pl[3], col);
             continue;
         }
 
@@ -712,68 +3243,42 @@ void gfx_finish_render(void)
     }
 }
 
+void gfx_finish_render(void)
+{
+    gfx_render_queue();
+
+    if (gfx_screen)
+        gfx_set_screen_clip(render_clip[0], render_clip[1], render_clip[2], render_clip[3]);
+}
+
 /* ----------------------------------------------------------------------
  * Sprites
  * --------------------------------------------------------------------*/
 
 void gfx_draw_sprite(int sprite_no, int x, int y)
 {
-    if (!gfx_screen) return;
-    al_set_target_bitmap(gfx_screen);
-
-    ALLEGRO_BITMAP *bmp = NULL;
-
-    switch (sprite_no)
-    {
-    case IMG_GREEN_DOT:
-        bmp = sprite_grn_dot;
-        break;
-
-    case IMG_RED_DOT:
-        bmp = sprite_red_dot;
-        break;
-
-    case IMG_BIG_S:
-        bmp = sprite_big_s;
-        break;
-
-    case IMG_ELITE_TXT:
-        bmp = sprite_elite_txt;
-        break;
-
-    case IMG_BIG_E:
-        bmp = sprite_big_e;
-        break;
+    ALLEGRO_BITMAP *bmp;
+    int bw;
 
-    case IMG_BLAKE:
-        bmp = sprite_blake;
-        break;
-
-    case IMG_MISSILE_GREEN:
-        bmp = sprite_missile_g;
-        break;
-
-    case IMG_MISSILE_YELLOW:
-        bmp = sprite_missile_y;
-        break;
-
-    case IMG_MISSILE_RED:
-        bmp = sprite_missile_r;
-        break;
-
-    default:
-        return;
-    }
+    if (!gfx_screen) return;
 
+    bmp = gfx_sprite_bitmap(sprite_no);
     if (!bmp)
         return;
 
-    int bw = al_get_bitmap_width(bmp);
-    int bh = al_get_bitmap_height(bmp);
+    bw = al_get_bitmap_width(bmp);
 
     if (x == -1)
         x = ((256 * GFX_SCALE) - bw) / 2;
 
+    if (gfx_indexed(y + GFX_Y_OFFSET))
+    {
+        sw_sprite(&index_surface, &index_sprites[sprite_no],
+                  x + GFX_X_OFFSET, y + GFX_Y_OFFSET);
+        return;
+    }
+
+    gfx_target_screen();
     al_draw_bitmap(bmp, x + GFX_X_OFFSET, y + GFX_Y_OFFSET, 0);
 }
 
@@ -51,7 +51,6 @@
 #include "file.h"
 #include "keyboard.h"
 
-int old_cross_x, old_cross_y;
 int cross_timer;
 
 int draw_lasers;
@@ -173,7 +172,7 @@ void draw_cross(int cx, int cy)
         gfx_set_clip_region(1, 37, 510, 339);
         gfx_draw_colour_line(cx - 16, cy, cx + 16, cy, GFX_COL_RED);
         gfx_draw_colour_line(cx, cy - 16, cx, cy + 16, GFX_COL_RED);
-        gfx_set_clip_region(1, 1, 510, 383);
+        gfx_set_clip_region(GFX_AREA_TX, GFX_AREA_TY, GFX_AREA_BX, GFX_AREA_BY);
         return;
     }
 
@@ -182,7 +181,7 @@ void draw_cross(int cx, int cy)
         gfx_set_clip_region(1, 37, 510, 293);
         gfx_draw_colour_line(cx - 8, cy, cx + 8, cy, GFX_COL_RED);
         gfx_draw_colour_line(cx, cy - 8, cx, cy + 8, GFX_COL_RED);
-        gfx_set_clip_region(1, 1, 510, 383);
+        gfx_set_clip_region(GFX_AREA_TX, GFX_AREA_TY, GFX_AREA_BX, GFX_AREA_BY);
     }
 }
 
@@ -216,31 +215,31 @@ void draw_laser_sights(void)
 
     if (laser)
     {
-        x1 = 128 * GFX_SCALE;
-        y1 = (96 - 8) * GFX_SCALE;
-        y2 = (96 - 16) * GFX_SCALE;
+        x1 = GFX_VIEW_X_CENTRE;
+        y1 = GFX_VIEW_Y_CENTRE - 8 * GFX_SCALE;
+        y2 = GFX_VIEW_Y_CENTRE - 16 * GFX_SCALE;
 
         gfx_draw_colour_line(x1 - 1, y1, x1 - 1, y2, GFX_COL_GREY_1);
         gfx_draw_colour_line(x1,     y1, x1,     y2, GFX_COL_WHITE);
         gfx_draw_colour_line(x1 + 1, y1, x1 + 1, y2, GFX_COL_GREY_1);
 
-        y1 = (96 + 8) * GFX_SCALE;
-        y2 = (96 + 16) * GFX_SCALE;
+        y1 = GFX_VIEW_Y_CENTRE + 8 * GFX_SCALE;
+        y2 = GFX_VIEW_Y_CENTRE + 16 * GFX_SCALE;
 
         gfx_draw_colour_line(x1 - 1, y1, x1 - 1, y2, GFX_COL_GREY_1);
         gfx_draw_colour_line(x1,     y1, x1,     y2, GFX_COL_WHITE);
         gfx_draw_colour_line(x1 + 1, y1, x1 + 1, y2, GFX_COL_GREY_1);
 
-        x1 = (128 - 8) * GFX_SCALE;
-        y1 = 96 * GFX_SCALE;
-        x2 = (128 - 16) * GFX_SCALE;
+        x1 = GFX_VIEW_X_CENTRE - 8 * GFX_SCALE;
+        y1 = GFX_VIEW_Y_CENTRE;
+        x2 = GFX_VIEW_X_CENTRE - 16 * GFX_SCALE;
 
         gfx_draw_colour_line(x1, y1 - 1, x2, y1 - 1, GFX_COL_GREY_1);
         gfx_draw_colour_line(x1, y1,     x2, y1,     GFX_COL_WHITE);
         gfx_draw_colour_line(x1, y1 + 1, x2, y1 + 1, GFX_COL_GREY_1);
 
-        x1 = (128 + 8) * GFX_SCALE;
-        x2 = (128 + 16) * GFX_SCALE;
+        x1 = GFX_VIEW_X_CENTRE + 8 * GFX_SCALE;
+        x2 = GFX_VIEW_X_CENTRE + 16 * GFX_SCALE;
 
         gfx_draw_colour_line(x1, y1 - 1, x2, y1 - 1, GFX_COL_GREY_1);
         gfx_draw_colour_line(x1, y1,     x2, y1,     GFX_COL_WHITE);
@@ -619,7 +618,7 @@ void run_escape_sequence(void)
             snd_play_sample(SND_EXPLODE);
         }
 
-        gfx_set_clip_region(1, 1, 510, 383);
+        gfx_set_clip_region(GFX_AREA_TX, GFX_AREA_TY, GFX_AREA_BX, GFX_AREA_BY);
         gfx_clear_display();
         update_starfield();
         update_universe();
@@ -650,7 +649,7 @@ void run_escape_sequence(void)
         }
 
         warp_stars = 1;
-        gfx_set_clip_region(1, 1, 510, 383);
+        gfx_set_clip_region(GFX_AREA_TX, GFX_AREA_TY, GFX_AREA_BX, GFX_AREA_BY);
         gfx_clear_display();
         update_starfield();
         update_universe();
@@ -746,14 +745,12 @@ void handle_flight_keys(void)
     if (kbd_F5_pressed)
     {
         find_input = 0;
-        old_cross_x = -1;
         display_galactic_chart();
     }
 
     if (kbd_F6_pressed)
     {
         find_input = 0;
-        old_cross_x = -1;
         display_short_range_chart();
     }
 
@@ -1097,7 +1094,7 @@ void run_game_over_screen(void)
     int type;
 
     current_screen = SCR_GAME_OVER;
-    gfx_set_clip_region(1, 1, 510, 383);
+    gfx_set_clip_region(GFX_AREA_TX, GFX_AREA_TY, GFX_AREA_BX, GFX_AREA_BY);
 
     flight_speed = 6;
     flight_roll = 0;
@@ -1137,15 +1134,18 @@ void display_break_pattern(void)
 {
     int i;
 
-    gfx_set_clip_region(1, 1, 510, 383);
+    gfx_set_clip_region(GFX_AREA_TX, GFX_AREA_TY, GFX_AREA_BX, GFX_AREA_BY);
     gfx_clear_display();
+    gfx_clip_to_view();
 
     for (i = 0; i < 20; i++)
     {
-        gfx_draw_circle(256, 192, 30 + i * 15, GFX_COL_WHITE);
+        gfx_draw_circle(GFX_VIEW_X_CENTRE, GFX_VIEW_Y_CENTRE, 30 + i * 15, GFX_COL_WHITE);
         gfx_update_screen();
     }
 
+    gfx_set_clip_region(GFX_AREA_TX, GFX_AREA_TY, GFX_AREA_BX, GFX_AREA_BY);
+
     if (docked)
     {
         check_mission_brief();
@@ -1182,6 +1182,11 @@ int main(void)
     initialise_allegro();
     read_config_file();
 
+    if (init_ship_models() == 1)
+    {
+        return 1;
+    }
+
     if (gfx_graphics_startup() == 1)
     {
         return 1;
@@ -1208,9 +1213,6 @@ int main(void)
         run_first_intro_screen();
         run_second_intro_screen();
 
-        old_cross_x = -1;
-        old_cross_y = -1;
-
         dock_player();
         display_commander_status();
 
@@ -1218,7 +1220,7 @@ int main(void)
         {
             snd_update_sound();
             gfx_update_screen();
-            gfx_set_clip_region(1, 1, 510, 383);
+            gfx_set_clip_region(GFX_AREA_TX, GFX_AREA_TY, GFX_AREA_BX, GFX_AREA_BY);
 
             rolling = 0;
             climbing = 0;
@@ -1346,18 +1348,12 @@ int main(void)
                 }
             }
 
-            /* Crosshair rendering – no xor_mode in Allegro 5, so we
-               redraw the chart and draw a fresh cross when position changes. */
-            if ((cross_x != old_cross_x) ||
-                (cross_y != old_cross_y))
+            /* Crosshair rendering – no xor_mode in Allegro 5, so the
+               retained chart is put back and the cross drawn over it. */
+            if ((current_screen == SCR_SHORT_RANGE) ||
+                (current_screen == SCR_GALACTIC_CHART))
             {
-                old_cross_x = cross_x;
-                old_cross_y = cross_y;
-
-                if (current_screen == SCR_SHORT_RANGE)
-                    display_short_range_chart();
-                else if (current_screen == SCR_GALACTIC_CHART)
-                    display_galactic_chart();
+                redraw_chart();
 
                 if (cross_x >= 0 && cross_y >= 0)
                     draw_cross(cross_x, cross_y);
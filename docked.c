@@ -237,7 +237,49 @@ void find_planet_by_name (char *find_name)
 
 
 
-void display_short_range_chart (void)
+/*
+ * The charts are drawn once into a retained layer and only drawn again
+ * when something they show changes, so the cursor can be moved over
+ * them without regenerating the whole galaxy every frame.
+ */
+
+static int chart_screen = -1;
+static int chart_galaxy_number;
+static struct galaxy_seed chart_galaxy;
+static struct galaxy_seed chart_planet;
+static int chart_fuel;
+
+
+static int same_seed (struct galaxy_seed a, struct galaxy_seed b)
+{
+	return (a.a == b.a) && (a.b == b.b) && (a.c == b.c) &&
+		   (a.d == b.d) && (a.e == b.e) && (a.f == b.f);
+}
+
+
+static int chart_is_current (void)
+{
+	return (chart_screen == current_screen) &&
+		   (chart_galaxy_number == cmdr.galaxy_number) &&
+		   (chart_fuel == cmdr.fuel) &&
+		   same_seed (chart_galaxy, cmdr.galaxy) &&
+		   same_seed (chart_planet, docked_planet);
+}
+
+
+static void save_chart (void)
+{
+	chart_screen = current_screen;
+	chart_galaxy_number = cmdr.galaxy_number;
+	chart_galaxy = cmdr.galaxy;
+	chart_planet = docked_planet;
+	chart_fuel = cmdr.fuel;
+
+	gfx_save_layer (1, 1, 510, 339);
+}
+
+
+static void draw_short_range_chart (void)
 {
     int i;
 	struct galaxy_seed glx;
@@ -248,8 +290,6 @@ void display_short_range_chart (void)
 	int row;
 	int blob_size;
 
-	current_screen = SCR_SHORT_RANGE;
-
 	gfx_clear_display();
 
 	gfx_display_centre_text (10, "SHORT RANGE CHART", 140, GFX_COL_GOLD);
@@ -327,6 +367,20 @@ void display_short_range_chart (void)
 		waggle_galaxy (&glx);
 		waggle_galaxy (&glx);
 	}
+}
+
+
+void display_short_range_chart (void)
+{
+	current_screen = SCR_SHORT_RANGE;
+
+	if (chart_is_current() && gfx_restore_layer())
+		gfx_clear_text_area();
+	else
+	{
+		draw_short_range_chart();
+		save_chart();
+	}
 
 	cross_x = ((hyperspace_planet.d - docked_planet.d) * 4 * GFX_SCALE) + GFX_X_CENTRE;
 	cross_y = ((hyperspace_planet.b - docked_planet.b) * 2 * GFX_SCALE) + GFX_Y_CENTRE;
@@ -335,7 +389,7 @@ void display_short_range_chart (void)
 
 
 
-void display_galactic_chart (void)
+static void draw_galactic_chart (void)
 {
     int i;
 	struct galaxy_seed glx;
@@ -343,8 +397,6 @@ void display_galactic_chart (void)
 	int px,py;
 	
 
-	current_screen = SCR_GALACTIC_CHART;
-
 	gfx_clear_display();
 
 	sprintf (str, "GALACTIC CHART %d", cmdr.galaxy_number + 1);
@@ -375,13 +427,45 @@ void display_galactic_chart (void)
 		waggle_galaxy (&glx);
 
 	}
+}
+
 
+void display_galactic_chart (void)
+{
+	current_screen = SCR_GALACTIC_CHART;
+
+	if (chart_is_current() && gfx_restore_layer())
+		gfx_clear_text_area();
+	else
+	{
+		draw_galactic_chart();
+		save_chart();
+	}
 
 	cross_x = hyperspace_planet.d * GFX_SCALE;
 	cross_y = (hyperspace_planet.b / (2 / GFX_SCALE)) + (18 * GFX_SCALE) + 1;
 }
 
 
+/*
+ * Put the chart for the current screen back so the cross hairs can be
+ * drawn over it.  Only redraws the chart itself if it has gone stale.
+ */
+
+void redraw_chart (void)
+{
+	if (chart_is_current() && gfx_restore_layer())
+		return;
+
+	if (current_screen == SCR_SHORT_RANGE)
+		draw_short_range_chart();
+	else
+		draw_galactic_chart();
+
+	save_chart();
+}
+
+
 
 
 
@@ -17,6 +17,7 @@
 
 void display_short_range_chart (void);
 void display_galactic_chart (void);
+void redraw_chart (void);
 void display_data_on_planet (void);
 void show_distance_to_planet (void);
 void move_cursor_to_origin (void);
@@ -38,6 +38,18 @@ int anti_alias_gfx = 0;
 int hoopy_casinos = 0;
 int speed_cap = 75;
 int instant_dock = 0;
+int indexed_gfx = 0;
+int vsync_mode = 0;
+int depth_buffer_gfx = 0;
+int render_threads = 0;
+int frame_width = 0;
+int frame_height = 0;
+int window_width = 0;
+int window_height = 0;
+int landscape_cache_file = 0;
+int view_width = 0;
+int view_height = 0;
+int projection_scale = 0;
 
 
 char scanner_filename[256];
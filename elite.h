@@ -137,6 +137,18 @@ extern int anti_alias_gfx;
 extern char scanner_filename[256];
 extern int hoopy_casinos;
 extern int instant_dock;
+extern int indexed_gfx;
+extern int vsync_mode;
+extern int depth_buffer_gfx;
+extern int render_threads;
+extern int frame_width;
+extern int frame_height;
+extern int window_width;
+extern int window_height;
+extern int landscape_cache_file;
+extern int view_width;
+extern int view_height;
+extern int projection_scale;
 extern int speed_cap;
 extern int scanner_cx;
 extern int scanner_cy;
@@ -33,7 +33,7 @@ void write_config_file (void)
 	if (fp == NULL)
 		return;
 
-	fprintf (fp, "%d\t\t# Game Speed, the lower the number the faster the game.\n", speed_cap);
+	fprintf (fp, "%d\t\t# Game Speed, milliseconds per frame (0 = as fast as possible).\n", speed_cap);
 
 	fprintf (fp, "%d\t\t# Graphics: 0 = Solid, 1 = Wireframe\n", wireframe);
 
@@ -47,6 +47,24 @@ void write_config_file (void)
 	
 	fprintf (fp, "newscan.cfg\t# Name of scanner config file to use.\n");
 
+	fprintf (fp, "%d\t\t# Screen: 0 = Allegro, 1 = 8-bit indexed (needs a restart)\n", indexed_gfx);
+
+	fprintf (fp, "%d\t\t# Vsync: 0 = off, 1 = on (needs a restart)\n", vsync_mode);
+
+	fprintf (fp, "%d\t\t# Solid ships: 0 = Sort faces, 1 = Depth buffer (needs a restart)\n", depth_buffer_gfx);
+
+	fprintf (fp, "%d\t\t# Render threads: 0 = one per CPU, 1 = main thread only (needs a restart)\n", render_threads);
+
+	fprintf (fp, "%d,%d\t\t# Frame size, grown to fit the view (needs a restart)\n", frame_width, frame_height);
+
+	fprintf (fp, "%d,%d\t\t# Window size, 0,0 = same as the frame (needs a restart)\n", window_width, window_height);
+
+	fprintf (fp, "%d\t\t# Keep fractal planets in landscape.dat: 0 = off, 1 = on\n", landscape_cache_file);
+
+	fprintf (fp, "%d,%d\t\t# View size, 0,0 = 512,384 (needs a restart)\n", view_width, view_height);
+
+	fprintf (fp, "%d\t\t# Projection scale, 0 = 4/3 of the view height (needs a restart)\n", projection_scale);
+
 	fclose (fp);
 }
 
@@ -54,15 +72,20 @@ void write_config_file (void)
 /*
  * Read a line from a .cfg file.
  * Ignore blanks, comments and strip white space.
+ * Returns 0 at the end of the file.
  */
 
-void read_cfg_line (char *str, int max_size, FILE *fp)
+int read_cfg_line (char *str, int max_size, FILE *fp)
 {
 	char *s;
 
 	do
 	{	
-		fgets (str, max_size, fp);
+		if (fgets (str, max_size, fp) == NULL)
+		{
+			*str = '\0';
+			return 0;
+		}
 
 		for (s = str; *s; s++)					/* End of line at LF or # */
 		{
@@ -86,6 +109,8 @@ void read_cfg_line (char *str, int max_size, FILE *fp)
 		}
 
 	} while (*str == '\0');
+
+	return 1;
 }
 
 
@@ -149,6 +174,35 @@ void read_config_file (void)
 
 	read_cfg_line (str, sizeof(str), fp);
 	read_scanner_config_file (str);
+
+	/* Options added since may be missing from older config files. */
+
+	if (read_cfg_line (str, sizeof(str), fp))
+		sscanf (str, "%d", &indexed_gfx);
+
+	if (read_cfg_line (str, sizeof(str), fp))
+		sscanf (str, "%d", &vsync_mode);
+
+	if (read_cfg_line (str, sizeof(str), fp))
+		sscanf (str, "%d", &depth_buffer_gfx);
+
+	if (read_cfg_line (str, sizeof(str), fp))
+		sscanf (str, "%d", &render_threads);
+
+	if (read_cfg_line (str, sizeof(str), fp))
+		sscanf (str, "%d,%d", &frame_width, &frame_height);
+
+	if (read_cfg_line (str, sizeof(str), fp))
+		sscanf (str, "%d,%d", &window_width, &window_height);
+
+	if (read_cfg_line (str, sizeof(str), fp))
+		sscanf (str, "%d", &landscape_cache_file);
+
+	if (read_cfg_line (str, sizeof(str), fp))
+		sscanf (str, "%d,%d", &view_width, &view_height);
+
+	if (read_cfg_line (str, sizeof(str), fp))
+		sscanf (str, "%d", &projection_scale);
 		
 	fclose (fp);
 }
@@ -29,47 +29,93 @@
 #ifdef RES_512_512
 
 #define GFX_SCALE		(2)
-#define GFX_X_OFFSET	(0)
-#define GFX_Y_OFFSET	(0)
+#define GFX_FRAME_W		(512)
+#define GFX_FRAME_H		(512)
 #define GFX_X_CENTRE	(256)
 #define GFX_Y_CENTRE	(192)
 
-#define GFX_VIEW_TX		1
-#define GFX_VIEW_TY		1
-#define GFX_VIEW_BX		509
-#define GFX_VIEW_BY		381
-
 #endif
 
 #ifdef RES_800_600
 
 #define GFX_SCALE		(2)
-#define GFX_X_OFFSET	(144)
-#define GFX_Y_OFFSET	(44)
+#define GFX_FRAME_W		(800)
+#define GFX_FRAME_H		(600)
 #define GFX_X_CENTRE	(256)
 #define GFX_Y_CENTRE	(192)
 
-#define GFX_VIEW_TX		1
-#define GFX_VIEW_TY		1
-#define GFX_VIEW_BX		509
-#define GFX_VIEW_BY		381
-
 #endif
 
 #ifndef GFX_SCALE
 
 #define GFX_SCALE		(1)
-#define GFX_X_OFFSET	(0)
-#define GFX_Y_OFFSET	(0)
+#define GFX_FRAME_W		(256)
+#define GFX_FRAME_H		(256)
 #define GFX_X_CENTRE	(128)
 #define GFX_Y_CENTRE	(96)
 
-#define GFX_VIEW_TX		1
-#define GFX_VIEW_TY		1
-#define GFX_VIEW_BX		253
-#define GFX_VIEW_BY		191
-
 #endif
+
+/*
+ * The game screen, a square holding the view with the console below it,
+ * is drawn in the middle of a frame whose size is read from newkind.cfg
+ * (GFX_FRAME_W by GFX_FRAME_H by default), so where it is in the frame
+ * is only known at run time.
+ */
+
+#define GFX_GAME_SIZE	(GFX_X_CENTRE * 2)
+
+extern int gfx_x_offset;
+extern int gfx_y_offset;
+
+#define GFX_X_OFFSET	(gfx_x_offset)
+#define GFX_Y_OFFSET	(gfx_y_offset)
+
+/*
+ * The space view.  Its size and projection scale are also read from
+ * newkind.cfg, by default GFX_X_CENTRE * 2 by GFX_Y_CENTRE * 2 with a
+ * scale of 4/3 of its height.  It is centred across the game screen and
+ * sits on the console, so a bigger view reaches past the sides and the
+ * top of the game screen and a smaller one is centred where the default
+ * view would be.  GFX_VIEW_LEFT and GFX_VIEW_TOP are in game screen
+ * coordinates, so they can be negative.
+ *
+ * The menus and charts keep the default view's layout.  The area is
+ * whichever is bigger of that and the view: it is what is cleared and
+ * clipped to above the console.
+ */
+
+#define GFX_VIEW_MAX_W	4096
+#define GFX_VIEW_MAX_H	4096
+
+extern int gfx_view_left;
+extern int gfx_view_top;
+extern int gfx_view_w;
+extern int gfx_view_h;
+extern int gfx_proj_scale;
+
+extern int gfx_area_left;
+extern int gfx_area_top;
+extern int gfx_area_w;
+extern int gfx_area_h;
+
+#define GFX_VIEW_LEFT		(gfx_view_left)
+#define GFX_VIEW_TOP		(gfx_view_top)
+#define GFX_VIEW_W			(gfx_view_w)
+#define GFX_VIEW_H			(gfx_view_h)
+#define GFX_VIEW_X_CENTRE	(gfx_view_left + gfx_view_w / 2)
+#define GFX_VIEW_Y_CENTRE	(gfx_view_top + gfx_view_h / 2)
+#define GFX_PROJ_SCALE		(gfx_proj_scale)
+
+#define GFX_VIEW_TX		(gfx_view_left + 1)
+#define GFX_VIEW_TY		(gfx_view_top + 1)
+#define GFX_VIEW_BX		(gfx_view_left + gfx_view_w - 3)
+#define GFX_VIEW_BY		(gfx_view_top + gfx_view_h - 3)
+
+#define GFX_AREA_TX		(gfx_area_left + 1)
+#define GFX_AREA_TY		(gfx_area_top + 1)
+#define GFX_AREA_BX		(gfx_area_left + gfx_area_w - 2)
+#define GFX_AREA_BY		(gfx_area_top + gfx_area_h - 1)
  
 
 
@@ -126,10 +172,14 @@
 int gfx_graphics_startup (void);
 void gfx_graphics_shutdown (void);
 void gfx_update_screen (void);
+int gfx_frame_stats (double *mean, double *jitter, double *worst);
 void gfx_acquire_screen (void);
 void gfx_release_screen (void);
 void gfx_plot_pixel (int x, int y, int col);
 void gfx_fast_plot_pixel (int x, int y, int col);
+void gfx_draw_span (int x, int y, int len, const unsigned char *cols);
+void gfx_draw_particles (int count, const int *x, const int *y,
+						 const unsigned char *w, const unsigned char *h, int col);
 void gfx_draw_filled_circle (int cx, int cy, int radius, int circle_colour);
 void gfx_draw_circle (int cx, int cy, int radius, int circle_colour);
 void gfx_draw_line (int x1, int y1, int x2, int y2);
@@ -144,13 +194,21 @@ void gfx_clear_text_area (void);
 void gfx_clear_area (int tx, int ty, int bx, int by);
 void gfx_display_pretty_text (int tx, int ty, int bx, int by, char *txt);
 void gfx_draw_scanner (void);
+void gfx_draw_scanner_area (int tx, int ty, int bx, int by);
 void gfx_set_clip_region (int tx, int ty, int bx, int by);
+void gfx_clip_to_view (void);
+void gfx_save_layer (int tx, int ty, int bx, int by);
+int gfx_restore_layer (void);
+void gfx_discard_layer (void);
 void gfx_polygon (int num_points, int *poly_list, int face_colour);
 void gfx_draw_sprite (int sprite_no, int x, int y);
 void gfx_start_render (void);
 void gfx_render_polygon (int num_points, int *point_list, int face_colour, int zavg);
+void gfx_render_depth_polygon (int num_points, int *point_list, const double *depth,
+							   int face_colour, int zavg);
 void gfx_render_line (int x1, int y1, int x2, int y2, int dist, int col);
 void gfx_finish_render (void);
+void gfx_run_parallel (void (*job)(int n, void *arg), int count, void *arg);
 int gfx_request_file (char *title, char *path, char *ext);
 
 #endif
@@ -564,6 +564,67 @@ void switch_to_view (struct univ_object *flip)
 }
 
 
+/*
+ * The cache of how each object looks out of the current view.  An
+ * entry is good for as long as the object keeps the same type, position
+ * and orientation and we keep looking out of the same view, which on
+ * the intro screens and while a ship just sits in front of us can be
+ * many frames.
+ */
+
+static struct view_object view_cache[MAX_UNIV_OBJECTS];
+
+
+struct view_object *object_view (int un)
+{
+	struct view_object *view;
+	struct univ_object *univ;
+	struct univ_object flip;
+	int i;
+	int x,y,z;
+	int y1,y2;
+
+	view = &view_cache[un];
+	univ = &universe[un];
+
+	if ((view->type == univ->type) && (view->screen == current_screen) &&
+		(memcmp (&view->from_location, &univ->location, sizeof (Vector)) == 0) &&
+		(memcmp (view->from_rotmat, univ->rotmat, sizeof (Matrix)) == 0))
+		return view;
+
+	flip = *univ;
+	switch_to_view (&flip);
+
+	view->type = univ->type;
+	view->screen = current_screen;
+	view->from_location = univ->location;
+	view->location = flip.location;
+
+	for (i = 0; i < 3; i++)
+	{
+		view->from_rotmat[i] = univ->rotmat[i];
+		view->rotmat[i] = flip.rotmat[i];
+	}
+
+	/* The scanner always looks forward. */
+
+	x = univ->location.x / 256;
+	y = univ->location.y / 256;
+	z = univ->location.z / 256;
+
+	y1 = -z / 4;
+	y2 = y1 - y / 2;
+
+	view->on_scanner = (y2 >= -28) && (y2 <= 28) && (x >= -50) && (x <= 50);
+	view->scan_x = x;
+	view->scan_y1 = y1;
+	view->scan_y2 = y2;
+
+	setup_view (view);
+	return view;
+}
+
+
 /*
  * Update all the objects in the universe and render them.
  */
@@ -575,6 +636,8 @@ void update_universe (void)
 	int bounty;
 	char str[80];
 	struct univ_object flip;
+	struct view_object *view;
+	int j;
 	
 	
 	gfx_start_render();
@@ -622,8 +685,12 @@ void update_universe (void)
 		
 			move_univ_object (&universe[i]);
 
+			view = object_view (i);
+
 			flip = universe[i];
-			switch_to_view (&flip);
+			flip.location = view->location;
+			for (j = 0; j < 3; j++)
+				flip.rotmat[j] = view->rotmat[j];
 			
 			if (type == SHIP_PLANET)
 			{
@@ -634,13 +701,13 @@ void update_universe (void)
 					make_station_appear();
 				}				
 
-				draw_ship (&flip);
+				draw_ship (&flip, view);
 				continue;
 			}
 
 			if (type == SHIP_SUN)
 			{
-				draw_ship (&flip);
+				draw_ship (&flip, view);
 				continue;
 			}
 			
@@ -661,7 +728,7 @@ void update_universe (void)
 				continue;
 			}
 
-			draw_ship (&flip);
+			draw_ship (&flip, view);
 
 			universe[i].flags = flip.flags;
 			universe[i].exp_seed = flip.exp_seed;
@@ -672,7 +739,7 @@ void update_universe (void)
 			if (universe[i].flags & FLG_DEAD)
 				continue;
 
-			check_target (i, &flip);
+			check_target (i, view);
 		}
 	}
 
@@ -690,9 +757,9 @@ void update_universe (void)
 void update_scanner (void)
 {
 	int i;
-	int x,y,z;
 	int x1,y1,y2;
 	int colour;
+	struct view_object *view;
 	
 	for (i = 0; i < MAX_UNIV_OBJECTS; i++)
 	{
@@ -701,21 +768,14 @@ void update_scanner (void)
 			(universe[i].flags & FLG_CLOAKED))
 			continue;
 	
-		x = universe[i].location.x / 256;
-		y = universe[i].location.y / 256;
-		z = universe[i].location.z / 256;
+		view = object_view (i);
 
-		x1 = x;
-		y1 = -z / 4;
-		y2 = y1 - y / 2;
-
-		if ((y2 < -28) || (y2 > 28) ||
-			(x1 < -50) || (x1 > 50))
+		if (!view->on_scanner)
 			continue;
 
-		x1 += scanner_cx;
-		y1 += scanner_cy;
-		y2 += scanner_cy;
+		x1 = view->scan_x + scanner_cx;
+		y1 = view->scan_y1 + scanner_cy;
+		y2 = view->scan_y2 + scanner_cy;
 
 		colour = (universe[i].flags & FLG_HOSTILE) ? GFX_COL_YELLOW_5 : GFX_COL_WHITE;
 			
@@ -962,33 +1022,201 @@ void display_missiles (void)
 }
 
 
+/*
+ * The console is drawn over the scanner bitmap, which stays on screen
+ * between frames.  Each gauge remembers the value it was last drawn
+ * with and is only erased (by copying back its part of the scanner
+ * bitmap) and redrawn when that value changes.  The scanner and the
+ * compass change every frame and are always redrawn.
+ */
+
+#define GAUGE_SPEED			0
+#define GAUGE_CLIMB			1
+#define GAUGE_ROLL			2
+#define GAUGE_SHIELDS		3
+#define GAUGE_ALTITUDE		4
+#define GAUGE_ENERGY		5
+#define GAUGE_CABIN_TEMP	6
+#define GAUGE_LASER_TEMP	7
+#define GAUGE_FUEL			8
+#define GAUGE_MISSILES		9
+#define GAUGE_SAFE			10
+#define GAUGE_ECM			11
+
+#define NO_OF_GAUGES		12
+
+struct gauge
+{
+	int tx, ty, bx, by;		/* area the gauge can draw in, inclusive */
+	int value;				/* value it was last drawn with */
+};
+
+static struct gauge gauges[NO_OF_GAUGES] =
+{
+	{416, 393, 481, 398, 0},	/* speed */
+	{420, 423, 479, 430, 0},	/* climb */
+	{420, 407, 479, 414, 0},	/* roll */
+	{ 31, 391,  95, 414, 0},	/* shields */
+	{ 31, 476,  95, 483, 0},	/* altitude */
+	{416, 445, 480, 506, 0},	/* energy */
+	{ 31, 444,  95, 451, 0},	/* cabin temp */
+	{ 31, 460,  95, 467, 0},	/* laser temp */
+	{ 31, 428,  95, 435, 0},	/* fuel */
+	{ 35, 498,  98, 509, 0},	/* missiles */
+	{387, 490, 402, 505, 0},	/* safe zone */
+	{115, 490, 130, 505, 0}		/* ecm */
+};
+
+static int console_drawn = 0;
+
+
+static int gauge_value (int g)
+{
+	int value = 0;
+
+	switch (g)
+	{
+		case GAUGE_SPEED:
+			value = flight_speed;
+			break;
+
+		case GAUGE_CLIMB:
+			value = flight_climb;
+			break;
+
+		case GAUGE_ROLL:
+			value = flight_roll;
+			break;
+
+		case GAUGE_SHIELDS:
+			value = (front_shield > 3) ? (front_shield / 4) : 0;
+			value = (value << 8) | ((aft_shield > 3) ? (aft_shield / 4) : 0);
+			break;
+
+		case GAUGE_ALTITUDE:
+			value = (myship.altitude > 3) ? (myship.altitude / 4) : 0;
+			break;
+
+		case GAUGE_ENERGY:
+			value = energy;
+			break;
+
+		case GAUGE_CABIN_TEMP:
+			value = (myship.cabtemp > 3) ? (myship.cabtemp / 4) : 0;
+			break;
+
+		case GAUGE_LASER_TEMP:
+			value = (laser_temp > 0) ? (laser_temp / 4) : -1;
+			break;
+
+		case GAUGE_FUEL:
+			value = (cmdr.fuel > 0) ? ((cmdr.fuel * 64) / myship.max_fuel) : -1;
+			break;
+
+		case GAUGE_MISSILES:
+			value = cmdr.missiles * 4;
+			if (missile_target != MISSILE_UNARMED)
+				value += (missile_target < 0) ? 1 : 2;
+			break;
+
+		case GAUGE_SAFE:
+			value = !docked && (ship_count[SHIP_CORIOLIS] || ship_count[SHIP_DODEC]);
+			break;
+
+		case GAUGE_ECM:
+			value = !docked && ecm_active;
+			break;
+	}
+
+	return value;
+}
+
+
+static void draw_gauge (int g)
+{
+	switch (g)
+	{
+		case GAUGE_SPEED:		display_speed();		break;
+		case GAUGE_CLIMB:		display_flight_climb();	break;
+		case GAUGE_ROLL:		display_flight_roll();	break;
+		case GAUGE_SHIELDS:		display_shields();		break;
+		case GAUGE_ALTITUDE:	display_altitude();		break;
+		case GAUGE_ENERGY:		display_energy();		break;
+		case GAUGE_CABIN_TEMP:	display_cabin_temp();	break;
+		case GAUGE_LASER_TEMP:	display_laser_temp();	break;
+		case GAUGE_FUEL:		display_fuel();			break;
+		case GAUGE_MISSILES:	display_missiles();		break;
+
+		case GAUGE_SAFE:
+			if (gauges[g].value)
+				gfx_draw_sprite (IMG_BIG_S, 387, 490);
+			break;
+
+		case GAUGE_ECM:
+			if (gauges[g].value)
+				gfx_draw_sprite (IMG_BIG_E, 115, 490);
+			break;
+	}
+}
+
+
+static int areas_overlap (struct gauge *gg, int tx, int ty, int bx, int by)
+{
+	return (gg->tx <= bx) && (gg->bx >= tx) && (gg->ty <= by) && (gg->by >= ty);
+}
+
+
 void update_console (void)
 {
+	int i;
+	int value;
+	int scan_tx, scan_bx;
+	int comp_tx, comp_ty, comp_bx, comp_by;
+
 	gfx_set_clip_region (0, 0, 512, 512);
-	gfx_draw_scanner();
+
+	if (!console_drawn)
+		gfx_draw_scanner();
+
+	/* The blips can reach the full height of the console, and a */
+	/* compass dot is at most 16 pixels across. */
 	
-	display_speed();
-	display_flight_climb();
-	display_flight_roll();
-	display_shields();
-	display_altitude();
-	display_energy();
-	display_cabin_temp();
-	display_laser_temp();
-	display_fuel();
-	display_missiles();
+	scan_tx = scanner_cx - 53;
+	scan_bx = scanner_cx + 52;
+	comp_tx = compass_centre_x - 16;
+	comp_ty = compass_centre_y - 16;
+	comp_bx = compass_centre_x + 16 + 15;
+	comp_by = compass_centre_y + 16 + 15;
+
+	if (console_drawn)
+	{
+		gfx_draw_scanner_area (scan_tx, 385, scan_bx, 511);
+		gfx_draw_scanner_area (comp_tx, comp_ty, comp_bx, comp_by);
+	}
+
+	for (i = 0; i < NO_OF_GAUGES; i++)
+	{
+		value = gauge_value (i);
+
+		if (console_drawn && (value == gauges[i].value) &&
+			!areas_overlap (&gauges[i], scan_tx, 385, scan_bx, 511) &&
+			!areas_overlap (&gauges[i], comp_tx, comp_ty, comp_bx, comp_by))
+			continue;
+
+		if (console_drawn)
+			gfx_draw_scanner_area (gauges[i].tx, gauges[i].ty, gauges[i].bx, gauges[i].by);
+
+		gauges[i].value = value;
+		draw_gauge (i);
+	}
+
+	console_drawn = 1;
 	
 	if (docked)
 		return;
 
 	update_scanner();
 	update_compass();
-
-	if (ship_count[SHIP_CORIOLIS] || ship_count[SHIP_DODEC])
-		gfx_draw_sprite (IMG_BIG_S, 387, 490);
-
-	if (ecm_active)
-		gfx_draw_sprite (IMG_BIG_E, 115, 490);
 }
 
 void increase_flight_roll (void)
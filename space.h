@@ -54,6 +54,32 @@ extern struct univ_object universe[MAX_UNIV_OBJECTS];
 extern int ship_count[NO_OF_SHIPS + 1];  /* many */
 
 
+/*
+ * An object as seen out of the current view.  One is kept for each
+ * universe slot and only worked out again when the object moves or we
+ * change view, so the drawing, targeting and scanner code all share it.
+ */
+
+struct view_object
+{
+	int type;					/* what the entry was worked out from */
+	int screen;
+	Vector from_location;
+	Matrix from_rotmat;
+
+	Vector location;			/* position and orientation in view space */
+	Matrix rotmat;
+	Matrix trans;				/* model to view rotation, a row per axis */
+	Vector eye;					/* where we are in the model's own space */
+	int sx, sy;					/* screen position of the centre, if in front */
+
+	int on_scanner;
+	int scan_x, scan_y1, scan_y2;
+};
+
+struct view_object *object_view (int un);
+
+
 
 void clear_universe (void);
 int add_new_ship (int ship_type, int x, int y, int z, struct vector *rotmat, int rotx, int rotz);
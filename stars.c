@@ -33,6 +33,14 @@ struct star
 
 struct star stars[20];
 
+/*
+ * Stars live in the original 256x192 screen units, centred on the
+ * middle of the view.  Stretch them over however big the view is.
+ */
+
+#define STAR_X(x)	(GFX_VIEW_X_CENTRE + (int)(x) * GFX_VIEW_W / 256)
+#define STAR_Y(y)	(GFX_VIEW_Y_CENTRE + (int)(y) * GFX_VIEW_H / 192)
+
 
 void create_new_stars (void)
 {
@@ -77,16 +85,10 @@ void front_starfield (void)
 	{
 		/* Plot the stars in their current locations... */
 
-		sy = stars[i].y;
-		sx = stars[i].x;
+		sy = STAR_Y(stars[i].y);
+		sx = STAR_X(stars[i].x);
 		zz = stars[i].z;
 
-		sx += 128;
-		sy += 96;
-
-		sx *= GFX_SCALE;
-		sy *= GFX_SCALE;
-
 		if ((!warp_stars) &&
 			(sx >= GFX_VIEW_TX) && (sx <= GFX_VIEW_BX) &&
 			(sy >= GFX_VIEW_TY) && (sy <= GFX_VIEW_BY))
@@ -127,7 +129,7 @@ void front_starfield (void)
 
 		
 		if (warp_stars)
-			gfx_draw_line (sx, sy, (xx + 128) * GFX_SCALE, (yy + 96) * GFX_SCALE);
+			gfx_draw_line (sx, sy, STAR_X(xx), STAR_Y(yy));
 		
 		sx = xx;
 		sy = yy;
@@ -173,16 +175,10 @@ void rear_starfield (void)
 	{
 		/* Plot the stars in their current locations... */
 
-		sy = stars[i].y;
-		sx = stars[i].x;
+		sy = STAR_Y(stars[i].y);
+		sx = STAR_X(stars[i].x);
 		zz = stars[i].z;
 
-		sx += 128;
-		sy += 96;
-
-		sx *= GFX_SCALE;
-		sy *= GFX_SCALE;
-
 		if ((!warp_stars) &&
 			(sx >= GFX_VIEW_TX) && (sx <= GFX_VIEW_BX) &&
 			(sy >= GFX_VIEW_TY) && (sy <= GFX_VIEW_BY))
@@ -220,16 +216,14 @@ void rear_starfield (void)
 		
 		if (warp_stars)
 		{
-			ey = yy;
-			ex = xx;
-			ex = (ex + 128) * GFX_SCALE;
-			ey = (ey + 96) * GFX_SCALE;
+			ey = STAR_Y(yy);
+			ex = STAR_X(xx);
 
 			if ((sx >= GFX_VIEW_TX) && (sx <= GFX_VIEW_BX) &&
 			   (sy >= GFX_VIEW_TY) && (sy <= GFX_VIEW_BY) &&
 			   (ex >= GFX_VIEW_TX) && (ex <= GFX_VIEW_BX) &&
 			   (ey >= GFX_VIEW_TY) && (ey <= GFX_VIEW_BY))
-				gfx_draw_line (sx, sy, (xx + 128) * GFX_SCALE, (yy + 96) * GFX_SCALE);
+				gfx_draw_line (sx, sy, ex, ey);
 		}
 		
 		stars[i].y = yy;
@@ -284,16 +278,10 @@ void side_starfield (void)
 	
 	for (i = 0; i < nstars; i++)
 	{
-		sy = stars[i].y;
-		sx = stars[i].x;
+		sy = STAR_Y(stars[i].y);
+		sx = STAR_X(stars[i].x);
 		zz = stars[i].z;
 
-		sx += 128;
-		sy += 96;
-
-		sx *= GFX_SCALE;
-		sy *= GFX_SCALE;
-
 		if ((!warp_stars) &&
 			(sx >= GFX_VIEW_TX) && (sx <= GFX_VIEW_BX) &&
 			(sy >= GFX_VIEW_TY) && (sy <= GFX_VIEW_BY))
@@ -329,7 +317,7 @@ void side_starfield (void)
 		stars[i].x = xx;
 
 		if (warp_stars)
-			gfx_draw_line (sx, sy, (xx + 128) * GFX_SCALE, (yy + 96) * GFX_SCALE);
+			gfx_draw_line (sx, sy, STAR_X(xx), STAR_Y(yy));
 
 		
 		if (abs(stars[i].x) >= 116)
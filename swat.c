@@ -345,13 +345,13 @@ void explode_object (int un)
 }
 
 
-void check_target (int un, struct univ_object *flip)
+void check_target (int un, struct view_object *view)
 {
 	struct univ_object *univ;
 	
 	univ = &universe[un];
 	
-	if (in_target (univ->type, flip->location.x, flip->location.y, flip->location.z))
+	if (in_target (univ->type, view->location.x, view->location.y, view->location.z))
 	{
 		if ((missile_target == MISSILE_ARMED) && (univ->type >= 0))
 		{
@@ -876,19 +876,26 @@ void tactics (int un)
 }
 
 
+/*
+ * The laser beams start from the bottom of the view at the same
+ * places as on the original 256 wide screen.
+ */
+
+#define LASER_X(x)	(GFX_VIEW_X_CENTRE + ((x) - 128) * GFX_VIEW_W / 256)
+
 void draw_laser_lines (void)
 {
 	if (wireframe)
 	{
-		gfx_draw_colour_line (32 * GFX_SCALE, GFX_VIEW_BY, laser_x, laser_y, GFX_COL_WHITE);
-		gfx_draw_colour_line (48 * GFX_SCALE, GFX_VIEW_BY, laser_x, laser_y, GFX_COL_WHITE);
-		gfx_draw_colour_line (208 * GFX_SCALE, GFX_VIEW_BY, laser_x, laser_y, GFX_COL_WHITE);
-		gfx_draw_colour_line (224 * GFX_SCALE, GFX_VIEW_BY, laser_x, laser_y, GFX_COL_WHITE);
+		gfx_draw_colour_line (LASER_X(32), GFX_VIEW_BY, laser_x, laser_y, GFX_COL_WHITE);
+		gfx_draw_colour_line (LASER_X(48), GFX_VIEW_BY, laser_x, laser_y, GFX_COL_WHITE);
+		gfx_draw_colour_line (LASER_X(208), GFX_VIEW_BY, laser_x, laser_y, GFX_COL_WHITE);
+		gfx_draw_colour_line (LASER_X(224), GFX_VIEW_BY, laser_x, laser_y, GFX_COL_WHITE);
 	}
 	else
 	{
-		gfx_draw_triangle (32 * GFX_SCALE, GFX_VIEW_BY, laser_x, laser_y,  48 * GFX_SCALE, GFX_VIEW_BY, GFX_COL_RED);
-		gfx_draw_triangle (208 * GFX_SCALE, GFX_VIEW_BY, laser_x, laser_y, 224 * GFX_SCALE, GFX_VIEW_BY, GFX_COL_RED);
+		gfx_draw_triangle (LASER_X(32), GFX_VIEW_BY, laser_x, laser_y,  LASER_X(48), GFX_VIEW_BY, GFX_COL_RED);
+		gfx_draw_triangle (LASER_X(208), GFX_VIEW_BY, laser_x, laser_y, LASER_X(224), GFX_VIEW_BY, GFX_COL_RED);
 	}		 
 }
 
@@ -930,8 +937,8 @@ int fire_laser (void)
 			if (energy > 1)
 				energy--;
 			
-			laser_x = ((rand() & 3) + 128 - 2) * GFX_SCALE;
-			laser_y = ((rand() & 3) + 96 - 2) * GFX_SCALE;
+			laser_x = GFX_VIEW_X_CENTRE + ((rand() & 3) - 2) * GFX_SCALE;
+			laser_y = GFX_VIEW_Y_CENTRE + ((rand() & 3) - 2) * GFX_SCALE;
 			
 			return 2;
 		}
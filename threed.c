@@ -16,6 +16,12 @@
 #include <stdio.h>
 #include <math.h>
 #include <ctype.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define THREED_HAVE_SIMD
+#endif
 
 #include "config.h"
 #include "elite.h"
@@ -28,114 +34,865 @@
 #include "space.h"
 #include "random.h"
 
-#define MAX(x,y) (((x) > (y)) ? (x) : (y))
+#define MAX(x,y) (((x) > (y)) ? (x) : (y))
+#define MIN(x,y) (((x) < (y)) ? (x) : (y))
+
+/*
+ * The projection.  A point at (x, y, z) in front of us is drawn
+ * (x / z, y / z) * PROJ_SCALE pixels from the middle of the view.  The
+ * scale and the view are set up from newkind.cfg (see gfx.h).
+ * PROJ_X_EDGE and PROJ_Y_EDGE are the x / z and y / z at the sides of
+ * the view.
+ */
+
+#define PROJ_SCALE		GFX_PROJ_SCALE
+#define PROJ_X_CENTRE	GFX_VIEW_X_CENTRE
+#define PROJ_Y_CENTRE	GFX_VIEW_Y_CENTRE
+#define PROJ_X_EDGE		((double)GFX_VIEW_W / 2 / PROJ_SCALE)
+#define PROJ_Y_EDGE		((double)GFX_VIEW_H / 2 / PROJ_SCALE)
+
+#define VIEW_LEFT		GFX_VIEW_LEFT
+#define VIEW_TOP		GFX_VIEW_TOP
+#define VIEW_RIGHT		(GFX_VIEW_LEFT + GFX_VIEW_W - 1)
+#define VIEW_BOTTOM		(GFX_VIEW_TOP + GFX_VIEW_H - 1)
+
+
+/*
+ * The planet landscape map.  It must be square, with a power of two
+ * size no smaller than LAND_GRID.  Level 0 is the map itself and each
+ * level after it is half the size of the one before, so a planet small
+ * on the screen reads a small map and a big one gets the detail.  Level
+ * k is held a column at a time, (LAND_X_MAX >> k) + 1 columns of
+ * (LAND_Y_MAX >> k) + 1.
+ */
+
+#define LAND_X_MAX	512
+#define LAND_Y_MAX	512
+#define LAND_LEVELS	7		/* down to 8 across */
+
+static unsigned char landscape[LAND_X_MAX+1][LAND_Y_MAX+1];
+static unsigned char land_mips[LAND_X_MAX * LAND_Y_MAX / 2];
+static unsigned char *land_level[LAND_LEVELS];
+
+static struct point point_list[100];
+
+
+/*
+ * The ship models rearranged for the transform loops.  The vertices
+ * of each model are held as separate x, y and z float arrays, and the
+ * per-point distance and face numbers (only needed to decide what is
+ * visible) are kept apart from them, so the loops that transform every
+ * point of every ship only touch the geometry.  All the arrays are
+ * carved out of one block allocated by init_ship_models().
+ */
+
+struct ship_model
+{
+	double radius;				/* bounding sphere about the origin */
+
+	int num_points;
+	float *xs;
+	float *ys;
+	float *zs;
+	unsigned char *dist;
+	unsigned char *faces;		/* face1..face4 of each point */
+
+	int num_faces;
+	float *nx;					/* face normals, normalised */
+	float *ny;
+	float *nz;
+
+	int num_solid_faces;		/* planes of the faces in ship_solids */
+	float *snx;					/* unit normal... */
+	float *sny;
+	float *snz;
+	float *sd;					/* ...and its dot product with the face */
+	unsigned char *sdist;		/* least detail distance of the face's points */
+};
+
+static struct ship_model ship_models[NO_OF_SHIPS + 1];
+static void *ship_model_block;
+
+
+/*
+ * Transform and perspective projection of a batch of model points.
+ * m is the (already transposed) rotation, one row per output axis, and
+ * loc the object's position.  Ships drawn solid clamp points behind the
+ * eye to z = 1 so their faces can still be sorted.
+ *
+ * The SIMD versions work in doubles, in the same order as the scalar
+ * loop and without fused multiply-adds, so they give the same screen
+ * coordinates.
+ */
+
+struct projection
+{
+	double m[3][3];
+	double loc[3];
+	int clamp_z;
+};
+
+static void (*project_points) (const struct projection *p, int n,
+							   const float *xs, const float *ys, const float *zs,
+							   struct point *out);
+
+
+static void setup_projection (struct projection *p, Matrix trans_mat,
+							  struct univ_object *univ, int clamp_z)
+{
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		p->m[i][0] = trans_mat[i].x;
+		p->m[i][1] = trans_mat[i].y;
+		p->m[i][2] = trans_mat[i].z;
+	}
+
+	p->loc[0] = univ->location.x;
+	p->loc[1] = univ->location.y;
+	p->loc[2] = univ->location.z;
+	p->clamp_z = clamp_z;
+}
+
+
+static void project_points_c (const struct projection *p, int n,
+							  const float *xs, const float *ys, const float *zs,
+							  struct point *out)
+{
+	int i;
+	int sx,sy;
+	double rx,ry,rz;
+
+	for (i = 0; i < n; i++)
+	{
+		rx = xs[i] * p->m[0][0] + ys[i] * p->m[0][1] + zs[i] * p->m[0][2] + p->loc[0];
+		ry = xs[i] * p->m[1][0] + ys[i] * p->m[1][1] + zs[i] * p->m[1][2] + p->loc[1];
+		rz = xs[i] * p->m[2][0] + ys[i] * p->m[2][1] + zs[i] * p->m[2][2] + p->loc[2];
+
+		if (p->clamp_z && (rz <= 0))
+			rz = 1;
+
+		sx = (rx * PROJ_SCALE) / rz;
+		sy = (ry * PROJ_SCALE) / rz;
+
+		sy = -sy;
+
+		sx += PROJ_X_CENTRE;
+		sy += PROJ_Y_CENTRE;
+
+		out[i].x = sx;
+		out[i].y = sy;
+		out[i].z = rz;
+	}
+}
+
+
+#ifdef THREED_HAVE_SIMD
+
+/* Two points at a time. */
+__attribute__((target("sse2")))
+static void project_points_sse2 (const struct projection *p, int n,
+								 const float *xs, const float *ys, const float *zs,
+								 struct point *out)
+{
+	__m128d m00 = _mm_set1_pd (p->m[0][0]), m01 = _mm_set1_pd (p->m[0][1]), m02 = _mm_set1_pd (p->m[0][2]);
+	__m128d m10 = _mm_set1_pd (p->m[1][0]), m11 = _mm_set1_pd (p->m[1][1]), m12 = _mm_set1_pd (p->m[1][2]);
+	__m128d m20 = _mm_set1_pd (p->m[2][0]), m21 = _mm_set1_pd (p->m[2][1]), m22 = _mm_set1_pd (p->m[2][2]);
+	__m128d lx = _mm_set1_pd (p->loc[0]), ly = _mm_set1_pd (p->loc[1]), lz = _mm_set1_pd (p->loc[2]);
+	__m128d scale = _mm_set1_pd (PROJ_SCALE);
+	__m128d one = _mm_set1_pd (1.0);
+	__m128d x, y, z, rx, ry, rz, le;
+	int sx[4], sy[4], sz[4];
+	int i, j;
+
+	for (i = 0; i + 2 <= n; i += 2)
+	{
+		x = _mm_cvtps_pd (_mm_castsi128_ps (_mm_loadl_epi64 ((const __m128i *)(xs + i))));
+		y = _mm_cvtps_pd (_mm_castsi128_ps (_mm_loadl_epi64 ((const __m128i *)(ys + i))));
+		z = _mm_cvtps_pd (_mm_castsi128_ps (_mm_loadl_epi64 ((const __m128i *)(zs + i))));
+
+		rx = _mm_add_pd (_mm_add_pd (_mm_add_pd (_mm_mul_pd (x, m00), _mm_mul_pd (y, m01)),
+									 _mm_mul_pd (z, m02)), lx);
+		ry = _mm_add_pd (_mm_add_pd (_mm_add_pd (_mm_mul_pd (x, m10), _mm_mul_pd (y, m11)),
+									 _mm_mul_pd (z, m12)), ly);
+		rz = _mm_add_pd (_mm_add_pd (_mm_add_pd (_mm_mul_pd (x, m20), _mm_mul_pd (y, m21)),
+									 _mm_mul_pd (z, m22)), lz);
+
+		if (p->clamp_z)
+		{
+			le = _mm_cmple_pd (rz, _mm_setzero_pd());
+			rz = _mm_or_pd (_mm_and_pd (le, one), _mm_andnot_pd (le, rz));
+		}
+
+		_mm_storeu_si128 ((__m128i *)sx, _mm_cvttpd_epi32 (_mm_div_pd (_mm_mul_pd (rx, scale), rz)));
+		_mm_storeu_si128 ((__m128i *)sy, _mm_cvttpd_epi32 (_mm_div_pd (_mm_mul_pd (ry, scale), rz)));
+		_mm_storeu_si128 ((__m128i *)sz, _mm_cvttpd_epi32 (rz));
+
+		for (j = 0; j < 2; j++)
+		{
+			out[i + j].x = sx[j] + PROJ_X_CENTRE;
+			out[i + j].y = PROJ_Y_CENTRE - sy[j];
+			out[i + j].z = sz[j];
+		}
+	}
+
+	if (i < n)
+		project_points_c (p, n - i, xs + i, ys + i, zs + i, out + i);
+}
+
+
+/*
+ * Four points at a time.  Only AVX instructions are needed for the
+ * doubles, but it is only picked on AVX2 machines.
+ */
+__attribute__((target("avx2")))
+static void project_points_avx2 (const struct projection *p, int n,
+								 const float *xs, const float *ys, const float *zs,
+								 struct point *out)
+{
+	__m256d m00 = _mm256_set1_pd (p->m[0][0]), m01 = _mm256_set1_pd (p->m[0][1]), m02 = _mm256_set1_pd (p->m[0][2]);
+	__m256d m10 = _mm256_set1_pd (p->m[1][0]), m11 = _mm256_set1_pd (p->m[1][1]), m12 = _mm256_set1_pd (p->m[1][2]);
+	__m256d m20 = _mm256_set1_pd (p->m[2][0]), m21 = _mm256_set1_pd (p->m[2][1]), m22 = _mm256_set1_pd (p->m[2][2]);
+	__m256d lx = _mm256_set1_pd (p->loc[0]), ly = _mm256_set1_pd (p->loc[1]), lz = _mm256_set1_pd (p->loc[2]);
+	__m256d scale = _mm256_set1_pd (PROJ_SCALE);
+	__m256d one = _mm256_set1_pd (1.0);
+	__m256d x, y, z, rx, ry, rz, le;
+	int sx[4], sy[4], sz[4];
+	int i, j;
+
+	for (i = 0; i + 4 <= n; i += 4)
+	{
+		x = _mm256_cvtps_pd (_mm_loadu_ps (xs + i));
+		y = _mm256_cvtps_pd (_mm_loadu_ps (ys + i));
+		z = _mm256_cvtps_pd (_mm_loadu_ps (zs + i));
+
+		rx = _mm256_add_pd (_mm256_add_pd (_mm256_add_pd (_mm256_mul_pd (x, m00), _mm256_mul_pd (y, m01)),
+										   _mm256_mul_pd (z, m02)), lx);
+		ry = _mm256_add_pd (_mm256_add_pd (_mm256_add_pd (_mm256_mul_pd (x, m10), _mm256_mul_pd (y, m11)),
+										   _mm256_mul_pd (z, m12)), ly);
+		rz = _mm256_add_pd (_mm256_add_pd (_mm256_add_pd (_mm256_mul_pd (x, m20), _mm256_mul_pd (y, m21)),
+										   _mm256_mul_pd (z, m22)), lz);
+
+		if (p->clamp_z)
+		{
+			le = _mm256_cmp_pd (rz, _mm256_setzero_pd(), _CMP_LE_OQ);
+			rz = _mm256_blendv_pd (rz, one, le);
+		}
+
+		_mm_storeu_si128 ((__m128i *)sx, _mm256_cvttpd_epi32 (_mm256_div_pd (_mm256_mul_pd (rx, scale), rz)));
+		_mm_storeu_si128 ((__m128i *)sy, _mm256_cvttpd_epi32 (_mm256_div_pd (_mm256_mul_pd (ry, scale), rz)));
+		_mm_storeu_si128 ((__m128i *)sz, _mm256_cvttpd_epi32 (rz));
+
+		for (j = 0; j < 4; j++)
+		{
+			out[i + j].x = sx[j] + PROJ_X_CENTRE;
+			out[i + j].y = PROJ_Y_CENTRE - sy[j];
+			out[i + j].z = sz[j];
+		}
+	}
+
+	if (i < n)
+		project_points_c (p, n - i, xs + i, ys + i, zs + i, out + i);
+}
+
+#endif
+
+
+static void select_project_points (void)
+{
+	project_points = project_points_c;
+
+#ifdef THREED_HAVE_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports ("avx2"))
+		project_points = project_points_avx2;
+	else if (__builtin_cpu_supports ("sse2"))
+		project_points = project_points_sse2;
+#endif
+}
+
+
+/*
+ * Get the point numbers of a solid face.  Returns how many there are.
+ */
+
+static int face_points (struct ship_face *face, int *index)
+{
+	index[0] = face->p1;
+	index[1] = face->p2;
+	index[2] = face->p3;
+	index[3] = face->p4;
+	index[4] = face->p5;
+	index[5] = face->p6;
+	index[6] = face->p7;
+	index[7] = face->p8;
+
+	return face->points;
+}
+
+
+int init_ship_models (void)
+{
+	int i, j, k, n;
+	int index[8];
+	int total_points;
+	int total_faces;
+	int total_solid_faces;
+	int total_floats;
+	float *fp;
+	unsigned char *cp;
+	struct ship_data *ship;
+	struct ship_model *model;
+	struct ship_face *face;
+	struct ship_point p1, p2, p3;
+	Vector vec;
+
+	select_project_points();
+
+	total_points = 0;
+	total_faces = 0;
+	total_solid_faces = 0;
+
+	for (i = 1; i <= NO_OF_SHIPS; i++)
+	{
+		total_points += ship_list[i]->num_points;
+		total_faces += ship_list[i]->num_faces;
+		total_solid_faces += ship_solids[i].num_faces;
+	}
+
+	total_floats = total_points * 3 + total_faces * 3 + total_solid_faces * 4;
+
+	ship_model_block = malloc (total_floats * sizeof(float) + total_points * 5 + total_solid_faces);
+	if (ship_model_block == NULL)
+		return 1;
+
+	fp = ship_model_block;
+	cp = (unsigned char *)(fp + total_floats);
+
+	for (i = 1; i <= NO_OF_SHIPS; i++)
+	{
+		ship = ship_list[i];
+		model = &ship_models[i];
+
+		model->num_points = ship->num_points;
+		model->xs = fp;
+		model->ys = fp + ship->num_points;
+		model->zs = fp + ship->num_points * 2;
+		fp += ship->num_points * 3;
+
+		model->dist = cp;
+		model->faces = cp + ship->num_points;
+		cp += ship->num_points * 5;
+
+		model->radius = 0;
+
+		for (j = 0; j < ship->num_points; j++)
+		{
+			vec.x = ship->points[j].x;
+			vec.y = ship->points[j].y;
+			vec.z = ship->points[j].z;
+
+			if (vector_dot_product (&vec, &vec) > model->radius * model->radius)
+				model->radius = sqrt (vector_dot_product (&vec, &vec));
+
+			model->xs[j] = ship->points[j].x;
+			model->ys[j] = ship->points[j].y;
+			model->zs[j] = ship->points[j].z;
+			model->dist[j] = ship->points[j].dist;
+			model->faces[j * 4 + 0] = ship->points[j].face1;
+			model->faces[j * 4 + 1] = ship->points[j].face2;
+			model->faces[j * 4 + 2] = ship->points[j].face3;
+			model->faces[j * 4 + 3] = ship->points[j].face4;
+		}
+
+		model->num_faces = ship->num_faces;
+		model->nx = fp;
+		model->ny = fp + ship->num_faces;
+		model->nz = fp + ship->num_faces * 2;
+		fp += ship->num_faces * 3;
+
+		for (j = 0; j < ship->num_faces; j++)
+		{
+			vec.x = ship->normals[j].x;
+			vec.y = ship->normals[j].y;
+			vec.z = ship->normals[j].z;
+
+			if ((vec.x != 0) || (vec.y != 0) || (vec.z != 0))
+				vec = unit_vector (&vec);
+
+			model->nx[j] = vec.x;
+			model->ny[j] = vec.y;
+			model->nz[j] = vec.z;
+		}
+
+		/*
+		 * The normals given with the solid faces are only rough, so
+		 * work the plane out from the first three points instead.
+		 * They go round clockwise seen from outside, which gives the
+		 * outward normal below.  Testing against this plane is the
+		 * same as checking the projected points go round clockwise.
+		 */
+
+		face = ship_solids[i].face_data;
+		model->num_solid_faces = ship_solids[i].num_faces;
+		model->snx = fp;
+		model->sny = fp + model->num_solid_faces;
+		model->snz = fp + model->num_solid_faces * 2;
+		model->sd = fp + model->num_solid_faces * 3;
+		fp += model->num_solid_faces * 4;
+		model->sdist = cp;
+		cp += model->num_solid_faces;
+
+		for (j = 0; j < model->num_solid_faces; j++)
+		{
+			p1 = ship->points[face[j].p1];
+			p2 = ship->points[face[j].p2];
+			p3 = ship->points[face[j].p3];
+
+			vec.x = (p3.y - p2.y) * (p1.z - p2.z) - (p3.z - p2.z) * (p1.y - p2.y);
+			vec.y = (p3.z - p2.z) * (p1.x - p2.x) - (p3.x - p2.x) * (p1.z - p2.z);
+			vec.z = (p3.x - p2.x) * (p1.y - p2.y) - (p3.y - p2.y) * (p1.x - p2.x);
+
+			if ((vec.x != 0) || (vec.y != 0) || (vec.z != 0))
+				vec = unit_vector (&vec);
+
+			model->snx[j] = vec.x;
+			model->sny[j] = vec.y;
+			model->snz[j] = vec.z;
+			model->sd[j] = vec.x * p2.x + vec.y * p2.y + vec.z * p2.z;
+
+			n = face_points (&face[j], index);
+			model->sdist[j] = 31;
+			for (k = 0; k < n; k++)
+				model->sdist[j] = MIN(model->sdist[j], ship->points[index[k]].dist);
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * Project just the points marked in used[] into point_list, leaving
+ * the other entries alone.
+ */
+
+static void project_used_points (struct ship_model *model, const struct projection *p,
+								 const unsigned char *used)
+{
+	float xs[100], ys[100], zs[100];
+	struct point out[100];
+	int index[100];
+	int i, n;
+
+	n = 0;
+
+	for (i = 0; i < model->num_points; i++)
+	{
+		if (used[i])
+		{
+			xs[n] = model->xs[i];
+			ys[n] = model->ys[i];
+			zs[n] = model->zs[i];
+			index[n] = i;
+			n++;
+		}
+	}
+
+	if (n == 0)
+		return;
+
+	project_points (p, n, xs, ys, zs, out);
+
+	for (i = 0; i < n; i++)
+		point_list[index[i]] = out[i];
+}
+
+
+/*
+ * Mark the points used by a solid face.
+ */
+
+static void mark_face_points (struct ship_face *face, unsigned char *used)
+{
+	int index[8];
+	int i, n;
+
+	n = face_points (face, index);
+
+	for (i = 0; i < n; i++)
+		used[index[i]] = 1;
+}
+
+
+/*
+ * Ships that come closer than NEAR_Z are clipped against that plane
+ * rather than projecting points that are level with or behind the eye.
+ * The positions of the points in view space are needed for that.
+ */
+
+#define NEAR_Z		8.0
+
+static double view_point[100][3];
+
+
+static void transform_used_points (struct ship_model *model, const struct projection *p,
+								   const unsigned char *used)
+{
+	int i;
+	float x, y, z;
+
+	for (i = 0; i < model->num_points; i++)
+	{
+		if (!used[i])
+			continue;
+
+		x = model->xs[i];
+		y = model->ys[i];
+		z = model->zs[i];
+
+		view_point[i][0] = x * p->m[0][0] + y * p->m[0][1] + z * p->m[0][2] + p->loc[0];
+		view_point[i][1] = x * p->m[1][0] + y * p->m[1][1] + z * p->m[1][2] + p->loc[1];
+		view_point[i][2] = x * p->m[2][0] + y * p->m[2][1] + z * p->m[2][2] + p->loc[2];
+	}
+}
+
+
+/*
+ * Where the line from a to b crosses the near plane.
+ */
+
+static void near_intersect (const double *a, const double *b, double *out)
+{
+	double t;
+
+	t = (NEAR_Z - a[2]) / (b[2] - a[2]);
+
+	out[0] = a[0] + (b[0] - a[0]) * t;
+	out[1] = a[1] + (b[1] - a[1]) * t;
+	out[2] = NEAR_Z;
+}
+
+
+/*
+ * Project a view space point the same way project_points() does.
+ */
+
+static void project_view_point (const double *v, int *sx, int *sy)
+{
+	int x, y;
+
+	x = (v[0] * PROJ_SCALE) / v[2];
+	y = (v[1] * PROJ_SCALE) / v[2];
+
+	*sx = x + PROJ_X_CENTRE;
+	*sy = PROJ_Y_CENTRE - y;
+}
+
+
+/*
+ * Clip a solid face against the near plane and queue what is left.
+ * Convex faces stay convex, gaining at most one point.
+ */
+
+static void render_clipped_face (struct ship_face *face, const double *depth)
+{
+	int index[8];
+	double clipped[9][3];
+	int poly_list[18];
+	const double *a, *b;
+	int i, n, np;
+	int zavg;
+
+	n = face_points (face, index);
+	np = 0;
+
+	if (n == 2)
+	{
+		a = view_point[index[0]];
+		b = view_point[index[1]];
+
+		if ((a[2] < NEAR_Z) && (b[2] < NEAR_Z))
+			return;
+
+		if (a[2] < NEAR_Z)
+			near_intersect (b, a, clipped[np]);
+		else
+			memcpy (clipped[np], a, sizeof(clipped[0]));
+		np++;
+
+		if (b[2] < NEAR_Z)
+			near_intersect (a, b, clipped[np]);
+		else
+			memcpy (clipped[np], b, sizeof(clipped[0]));
+		np++;
+	}
+	else
+	{
+		for (i = 0; i < n; i++)
+		{
+			a = view_point[index[(i + n - 1) % n]];
+			b = view_point[index[i]];
+
+			if (b[2] >= NEAR_Z)
+			{
+				if (a[2] < NEAR_Z)
+					near_intersect (a, b, clipped[np++]);
+
+				memcpy (clipped[np++], b, sizeof(clipped[0]));
+			}
+			else if (a[2] >= NEAR_Z)
+				near_intersect (a, b, clipped[np++]);
+		}
+
+		if (np < 3)
+			return;
+	}
+
+	zavg = 0;
+
+	for (i = 0; i < np; i++)
+	{
+		project_view_point (clipped[i], &poly_list[i * 2], &poly_list[i * 2 + 1]);
+		zavg = MAX(zavg, (int)clipped[i][2]);
+	}
+
+	gfx_render_depth_polygon (np, poly_list, depth, face->colour, zavg);
+}
+
+
+/*
+ * The plane of a solid face in the form the depth buffer wants: 1/z
+ * at screen point (x, y) is depth[0] * x + depth[1] * y + depth[2].
+ * Returns NULL when the face is edge on and has no such form.
+ */
+
+static const double *face_depth_plane (struct ship_model *model, int face,
+									   const struct projection *p, double *depth)
+{
+	double nx, ny, nz, d;
+
+	nx = model->snx[face] * p->m[0][0] + model->sny[face] * p->m[0][1] + model->snz[face] * p->m[0][2];
+	ny = model->snx[face] * p->m[1][0] + model->sny[face] * p->m[1][1] + model->snz[face] * p->m[1][2];
+	nz = model->snx[face] * p->m[2][0] + model->sny[face] * p->m[2][1] + model->snz[face] * p->m[2][2];
+	d = model->sd[face] + nx * p->loc[0] + ny * p->loc[1] + nz * p->loc[2];
+
+	if (fabs (d) < 1e-6)
+		return NULL;
+
+	/* Screen point (x, y) looks along ((x - PROJ_X_CENTRE) / PROJ_SCALE,
+	   (PROJ_Y_CENTRE - y) / PROJ_SCALE, 1). */
+
+	depth[0] = nx / (PROJ_SCALE * d);
+	depth[1] = -ny / (PROJ_SCALE * d);
+	depth[2] = (nz - (nx * PROJ_X_CENTRE - ny * PROJ_Y_CENTRE) / PROJ_SCALE) / d;
+
+	return depth;
+}
+
+
+/*
+ * Fill in the parts of an object's view that drawing it needs: the
+ * rotation from the model into view space, our position in the model's
+ * own space and where its centre falls on the screen.
+ */
+
+void setup_view (struct view_object *view)
+{
+	Matrix trans_mat;
+	double tmp;
+	int i;
+	int sx, sy;
+
+	for (i = 0; i < 3; i++)
+		trans_mat[i] = view->rotmat[i];
+
+	view->eye = view->location;
+	mult_vector (&view->eye, trans_mat);
+
+	tmp = trans_mat[0].y;
+	trans_mat[0].y = trans_mat[1].x;
+	trans_mat[1].x = tmp;
+
+	tmp = trans_mat[0].z;
+	trans_mat[0].z = trans_mat[2].x;
+	trans_mat[2].x = tmp;
+
+	tmp = trans_mat[1].z;
+	trans_mat[1].z = trans_mat[2].y;
+	trans_mat[2].y = tmp;
+
+	for (i = 0; i < 3; i++)
+		view->trans[i] = trans_mat[i];
+
+	if (view->location.z <= 0)
+		return;
+
+	sx = (view->location.x * PROJ_SCALE) / view->location.z;
+	sy = (view->location.y * PROJ_SCALE) / view->location.z;
+
+	view->sx = sx + PROJ_X_CENTRE;
+	view->sy = PROJ_Y_CENTRE - sy;
+}
+
+
+/*
+ * Is any part of a ship's bounding sphere in view?  The view covers
+ * x/z from -PROJ_X_EDGE to PROJ_X_EDGE and y/z likewise; the square
+ * roots are the lengths of the side planes' normals.
+ */
+
+static int ship_in_view (struct univ_object *univ)
+{
+	double radius;
+	double x, y, z;
+
+	radius = ship_models[univ->type].radius;
+	x = fabs (univ->location.x);
+	y = fabs (univ->location.y);
+	z = univ->location.z;
+
+	if (z + radius < NEAR_Z)
+		return 0;
+
+	if (x - z * PROJ_X_EDGE > radius * sqrt (1 + PROJ_X_EDGE * PROJ_X_EDGE))
+		return 0;
+
+	if (y - z * PROJ_Y_EDGE > radius * sqrt (1 + PROJ_Y_EDGE * PROJ_Y_EDGE))
+		return 0;
+
+	return 1;
+}
+
+
+/*
+ * Level of detail.  As on the BBC, a ship further away than its
+ * vanish_point (in units of 256) is drawn as a dot.  The distances on
+ * the points, lines and faces are in units of 1024, so that the full
+ * detail value of 31 lasts out every vanish_point in the tables, and
+ * anything with a distance below the ship's is left out.
+ */
+
+#define VANISH_SHIFT	8
+#define DETAIL_SHIFT	10
+
+static int ship_detail (struct univ_object *univ)
+{
+	if (univ->location.z <= 0)
+		return 0;
+
+	return (int)univ->location.z >> DETAIL_SHIFT;
+}
+
+
+static int ship_vanished (struct univ_object *univ)
+{
+	if (univ->location.z <= 0)
+		return 0;
 
+	return ((int)univ->location.z >> VANISH_SHIFT) >= ship_list[univ->type]->vanish_point;
+}
 
-#define LAND_X_MAX	128
-#define LAND_Y_MAX	128
 
-static unsigned char landscape[LAND_X_MAX+1][LAND_Y_MAX+1];
+static void draw_ship_dot (struct view_object *view)
+{
+	int sx, sy;
 
-static struct point point_list[100];
+	sx = view->sx;
+	sy = view->sy;
+
+	if ((sx < GFX_VIEW_TX) || (sx >= GFX_VIEW_BX) ||
+		(sy < GFX_VIEW_TY) || (sy >= GFX_VIEW_BY))
+		return;
+
+	gfx_plot_pixel (sx, sy, GFX_COL_WHITE);
+	gfx_plot_pixel (sx + 1, sy, GFX_COL_WHITE);
+	gfx_plot_pixel (sx, sy + 1, GFX_COL_WHITE);
+	gfx_plot_pixel (sx + 1, sy + 1, GFX_COL_WHITE);
+}
 
 
 /*
  * The following routine is used to draw a wireframe represtation of a ship.
  *
  * caveat: it is a work in progress.
- * A number of features (such as not showing detail at distance) have not yet been implemented.
  *
  */
 
-void draw_wireframe_ship (struct univ_object *univ)
+void draw_wireframe_ship (struct univ_object *univ, struct view_object *view)
 {
-	Matrix trans_mat;
 	int i;
 	int sx,sy,ex,ey;
-	double rx,ry,rz;
 	int visible[32];
-	Vector vec;
+	unsigned char shown[64];
+	unsigned char used[100];
+	int detail;
+	struct projection proj;
 	Vector camera_vec;
 	double cos_angle;
-	double tmp;
-	struct ship_face_normal *ship_norm;
 	int num_faces;
 	struct ship_data *ship;
+	struct ship_model *model;
 	int lasv;
+	int near;
+	const double *a, *b;
+	double clipped[3];
 
 	ship = ship_list[univ->type];
+	model = &ship_models[univ->type];
 	
-	for (i = 0; i < 3; i++)
-		trans_mat[i] = univ->rotmat[i];
-		
-	camera_vec = univ->location;
-	mult_vector (&camera_vec, trans_mat);
-	camera_vec = unit_vector (&camera_vec);
+	camera_vec = unit_vector (&view->eye);
 	
-	num_faces = ship->num_faces;
+	num_faces = model->num_faces;
+	detail = ship_detail (univ);
 	
 	for (i = 0; i < num_faces; i++)
 	{
-		ship_norm = ship->normals;
-
-		vec.x = ship_norm[i].x;
-		vec.y = ship_norm[i].y;
-		vec.z = ship_norm[i].z;
-
-		if ((vec.x == 0) && (vec.y == 0) && (vec.z == 0))
+		if (ship->normals[i].dist < detail)
+			visible[i] = 0;
+		else if ((model->nx[i] == 0) && (model->ny[i] == 0) && (model->nz[i] == 0))
 			visible[i] = 1;
 		else
 		{
-			vec = unit_vector (&vec);
-			cos_angle = vector_dot_product (&vec, &camera_vec);
+			cos_angle = model->nx[i] * camera_vec.x + model->ny[i] * camera_vec.y +
+						model->nz[i] * camera_vec.z;
 			visible[i] = (cos_angle < -0.2);
 		}
 	}
 
-	tmp = trans_mat[0].y;
-	trans_mat[0].y = trans_mat[1].x;
-	trans_mat[1].x = tmp;
-
-	tmp = trans_mat[0].z;
-	trans_mat[0].z = trans_mat[2].x;
-	trans_mat[2].x = tmp;
+	/* Only the ends of lines that will be drawn need projecting. */
 
-	tmp = trans_mat[1].z;
-	trans_mat[1].z = trans_mat[2].y;
-	trans_mat[2].y = tmp;
+	memset (used, 0, model->num_points);
 
-	for (i = 0; i < ship->num_points; i++)
+	for (i = 0; i < ship->num_lines; i++)
 	{
-		vec.x = ship->points[i].x;
-		vec.y = ship->points[i].y;
-		vec.z = ship->points[i].z;
-
-		mult_vector (&vec, trans_mat);
+		shown[i] = (visible[ship->lines[i].face1] || visible[ship->lines[i].face2]) &&
+				   (ship->lines[i].dist >= detail) &&
+				   (model->dist[ship->lines[i].start_point] >= detail) &&
+				   (model->dist[ship->lines[i].end_point] >= detail);
 
-		rx = vec.x + univ->location.x;
-		ry = vec.y + univ->location.y;
-		rz = vec.z + univ->location.z;
-
-		sx = (rx * 256) / rz;
-		sy = (ry * 256) / rz;
-
-		sy = -sy;
-
-		sx += 128;
-		sy += 96;
+		if (shown[i])
+		{
+			used[ship->lines[i].start_point] = 1;
+			used[ship->lines[i].end_point] = 1;
+		}
+	}
 
-		sx *= GFX_SCALE;
-		sy *= GFX_SCALE;
+	lasv = ship->front_laser;
+	if (univ->flags & FLG_FIRING)
+		used[lasv] = 1;
 
-		point_list[i].x = sx;
-		point_list[i].y = sy;
+	setup_projection (&proj, view->trans, univ, 0);
+	project_used_points (model, &proj, used);
 
-	}
+	near = (univ->location.z - model->radius) < NEAR_Z;
+	if (near)
+		transform_used_points (model, &proj, used);
 
 	for (i = 0; i < ship->num_lines; i++)
 	{
-		if (visible[ship->lines[i].face1] ||
-			visible[ship->lines[i].face2])
+		if (shown[i])
 		{
 			sx = point_list[ship->lines[i].start_point].x;
 			sy = point_list[ship->lines[i].start_point].y;
@@ -143,6 +900,26 @@ void draw_wireframe_ship (struct univ_object *univ)
 			ex = point_list[ship->lines[i].end_point].x;
 			ey = point_list[ship->lines[i].end_point].y;
 
+			if (near)
+			{
+				a = view_point[ship->lines[i].start_point];
+				b = view_point[ship->lines[i].end_point];
+
+				if ((a[2] < NEAR_Z) && (b[2] < NEAR_Z))
+					continue;
+
+				if (a[2] < NEAR_Z)
+				{
+					near_intersect (b, a, clipped);
+					project_view_point (clipped, &sx, &sy);
+				}
+				else if (b[2] < NEAR_Z)
+				{
+					near_intersect (a, b, clipped);
+					project_view_point (clipped, &ex, &ey);
+				}
+			}
+
 			gfx_draw_line (sx, sy, ex, ey);
 		}
 	}
@@ -150,9 +927,9 @@ void draw_wireframe_ship (struct univ_object *univ)
 
 	if (univ->flags & FLG_FIRING)
 	{
-		lasv = ship_list[univ->type]->front_laser;
 		gfx_draw_line (point_list[lasv].x, point_list[lasv].y,
-					   univ->location.x > 0 ? 0 : 511, rand255() * 2);
+					   univ->location.x > 0 ? VIEW_LEFT : VIEW_RIGHT,
+					   VIEW_TOP + rand255() * GFX_VIEW_H / 192);
 	}
 }
 
@@ -166,103 +943,84 @@ void draw_wireframe_ship (struct univ_object *univ)
  * Check for hidden surface supplied by T.Harte.
  */
 
-void draw_solid_ship (struct univ_object *univ)
+void draw_solid_ship (struct univ_object *univ, struct view_object *view)
 {
 	int i;
-	int sx,sy;
-	double rx,ry,rz;
-	struct vector vec;
-	struct vector camera_vec;
-	double tmp;
+	struct projection proj;
 	struct ship_face *face_data;
 	int num_faces;
 	int num_points;
 	int poly_list[16];
 	int zavg;
 	struct ship_solid *solid_data;
-	struct ship_data *ship;
-	Matrix trans_mat;
+	struct ship_model *model;
+	int visible[32];
+	unsigned char used[100];
+	int detail;
+	double plane[3];
+	const double *depth;
 	int lasv;
 	int col;
 
 	solid_data = &ship_solids[univ->type];
-	ship = ship_list[univ->type];
+	model = &ship_models[univ->type];
 	
-	for (i = 0; i < 3; i++)
-		trans_mat[i] = univ->rotmat[i];
-		
-	camera_vec = univ->location;
-	mult_vector (&camera_vec, trans_mat);
-	camera_vec = unit_vector (&camera_vec);
-
 	num_faces = solid_data->num_faces;
 	face_data = solid_data->face_data;
 
-/*
+	/*
+	 * The view's eye is the ship's position relative to us in the
+	 * ship's own space, which puts us at minus that.  A face can be
+	 * seen if that is on the outside of its plane.  Only the points
+	 * of those faces are projected.
+	 */
+
+	memset (used, 0, model->num_points);
+	detail = ship_detail (univ);
+
 	for (i = 0; i < num_faces; i++)
 	{
-		vec.x = face_data[i].norm_x;
-		vec.y = face_data[i].norm_y;
-		vec.z = face_data[i].norm_z;
+		if (model->sdist[i] < detail)
+		{
+			visible[i] = 0;
+			continue;
+		}
 
-		vec = unit_vector (&vec);
-		cos_angle = vector_dot_product (&vec, &camera_vec);
+		visible[i] = (model->snx[i] * view->eye.x + model->sny[i] * view->eye.y +
+					  model->snz[i] * view->eye.z + model->sd[i]) <= 0;
 
-		visible[i] = (cos_angle < -0.13);
+		if (visible[i])
+			mark_face_points (&face_data[i], used);
 	}
-*/
-
-	tmp = trans_mat[0].y;
-	trans_mat[0].y = trans_mat[1].x;
-	trans_mat[1].x = tmp;
 
-	tmp = trans_mat[0].z;
-	trans_mat[0].z = trans_mat[2].x;
-	trans_mat[2].x = tmp;
+	lasv = ship_list[univ->type]->front_laser;
+	if (univ->flags & FLG_FIRING)
+		used[lasv] = 1;
 
-	tmp = trans_mat[1].z;
-	trans_mat[1].z = trans_mat[2].y;
-	trans_mat[2].y = tmp;
+	setup_projection (&proj, view->trans, univ, 1);
+	project_used_points (model, &proj, used);
 
+	/* Up close, faces that reach the near plane have to be clipped. */
 
-	for (i = 0; i < ship->num_points; i++)
+	if ((univ->location.z - model->radius) < NEAR_Z)
 	{
-		vec.x = ship->points[i].x;
-		vec.y = ship->points[i].y;
-		vec.z = ship->points[i].z;
-
-		mult_vector (&vec, trans_mat);
-
-		rx = vec.x + univ->location.x;
-		ry = vec.y + univ->location.y;
-		rz = vec.z + univ->location.z;
-
-		if (rz <= 0)
-			rz = 1;
-		
-		sx = (rx * 256) / rz;
-		sy = (ry * 256) / rz;
-
-		sy = -sy;
-
-		sx += 128;
-		sy += 96;
+		transform_used_points (model, &proj, used);
 
-		sx *= GFX_SCALE;
-		sy *= GFX_SCALE;
+		for (i = 0; i < num_faces; i++)
+		{
+			if (visible[i])
+			{
+				depth = depth_buffer_gfx ? face_depth_plane (model, i, &proj, plane) : NULL;
+				render_clipped_face (&face_data[i], depth);
+			}
+		}
 
-		point_list[i].x = sx;
-		point_list[i].y = sy;
-		point_list[i].z = rz;
-		
+		num_faces = 0;
 	}
 
 	for (i = 0; i < num_faces; i++)
 	{
-		if (((point_list[face_data[i].p1].x - point_list[face_data[i].p2].x) * 
-		     (point_list[face_data[i].p3].y - point_list[face_data[i].p2].y) -
-			 (point_list[face_data[i].p1].y - point_list[face_data[i].p2].y) *
-			 (point_list[face_data[i].p3].x - point_list[face_data[i].p2].x)) <= 0)
+		if (visible[i])
 		{
 			num_points = face_data[i].points;
 
@@ -317,18 +1075,19 @@ void draw_solid_ship (struct univ_object *univ)
 			}
 			
 
-			gfx_render_polygon (face_data[i].points, poly_list, face_data[i].colour, zavg);
+			depth = depth_buffer_gfx ? face_depth_plane (model, i, &proj, plane) : NULL;
+			gfx_render_depth_polygon (face_data[i].points, poly_list, depth, face_data[i].colour, zavg);
 			
 		}
 	}
 
 	if (univ->flags & FLG_FIRING)
 	{
-		lasv = ship_list[univ->type]->front_laser;
 		col = (univ->type == SHIP_VIPER) ? GFX_COL_CYAN : GFX_COL_WHITE; 
 		
 		gfx_render_line (point_list[lasv].x, point_list[lasv].y,
-						 univ->location.x > 0 ? 0 : 511, rand255() * 2,
+						 univ->location.x > 0 ? VIEW_LEFT : VIEW_RIGHT,
+						 VIEW_TOP + rand255() * GFX_VIEW_H / 192,
 						 point_list[lasv].z, col);
 	}
 }
@@ -367,6 +1126,26 @@ int snes_planet_colour[] =
 }; 
 
 
+/*
+ * Point land_level[] at where each level is kept.
+ */
+
+static void init_land_levels (void)
+{
+	unsigned char *next;
+	int k;
+
+	land_level[0] = &landscape[0][0];
+	next = land_mips;
+
+	for (k = 1; k < LAND_LEVELS; k++)
+	{
+		land_level[k] = next;
+		next += ((LAND_X_MAX >> k) + 1) * ((LAND_Y_MAX >> k) + 1);
+	}
+}
+
+
 /*
  * Generate a landscape map for a SNES Elite style planet.
  */
@@ -374,175 +1153,608 @@ int snes_planet_colour[] =
 void generate_snes_landscape (void)
 {
 	int x,y;
+	int w,h;
+	int k;
 	int colour;
-	
-	for (y = 0; y <= LAND_Y_MAX; y++)
+	unsigned char *map;
+
+	if (land_level[0] == NULL)
+		init_land_levels();
+
+	for (k = 0; k < LAND_LEVELS; k++)
 	{
-		colour = snes_planet_colour[y * (sizeof(snes_planet_colour)/sizeof(int)) / LAND_Y_MAX];  
-		for (x = 0; x <= LAND_X_MAX; x++)
+		map = land_level[k];
+		w = LAND_X_MAX >> k;
+		h = LAND_Y_MAX >> k;
+
+		for (y = 0; y <= h; y++)
 		{
-			landscape[x][y] = colour;		
+			colour = snes_planet_colour[y * (sizeof(snes_planet_colour)/sizeof(int)) / (h + 1)];
+			for (x = 0; x <= w; x++)
+			{
+				map[x * (h + 1) + y] = colour;
+			}
 		}
-	}	
+	}
 }
 
 
 
 
 /*
- * Guassian random number generator.
- * Returns a number between -7 and +8 with Gaussian distribution.
+ * Fractal landscape, made by midpoint displacement.  It starts from a
+ * LAND_GRID x LAND_GRID grid of random heights and each level halves
+ * the spacing: every new point is the average of the two points either
+ * side of it plus a little Gaussian noise.
+ *
+ * The randomness for a point comes from a hash of the seed and the
+ * point's place in the map, not from the game's random numbers.  So the
+ * points of a level can be worked out in any order: the noise for a
+ * line of points is made in bulk (eight at a time on AVX2 machines) and
+ * the columns of a level are shared out between the render threads, and
+ * the same seed always gives the same landscape.
  */
 
-int grand (void)
+#define LAND_GRID	8
+
+static void (*land_noise) (unsigned int key, int x, int y, int step, int n, int *out);
+
+
+static unsigned int land_hash (unsigned int h)
 {
-	int i;
-	int r;
-	
-	r = 0;
-	for (i = 0; i < 12; i++)
-		r += randint() & 15;
-	
-	r /= 12;
-	r -= 7;
+	h ^= h >> 16;
+	h *= 0x7feb352d;
+	h ^= h >> 15;
+	h *= 0x846ca68b;
+	h ^= h >> 16;
 
-	return r;
+	return h;
 }
 
 
 /*
- * Calculate the midpoint between two given points.
+ * The sum of the eight nibbles of h.
  */
 
-int calc_midpoint (int sx, int sy, int ex, int ey)
+static unsigned int nibble_sum (unsigned int h)
 {
-	int a,b,n;
+	h = (h & 0x0F0F0F0F) + ((h >> 4) & 0x0F0F0F0F);
+	h += h >> 8;
+	h += h >> 16;
 
-	a = landscape[sx][sy];
-	b = landscape[ex][ey];
-	
-	n = ((a + b) / 2) + grand();
+	return h & 255;
+}
+
+
+/*
+ * Noise for the n points (x, y), (x, y + step) ...  Like the old
+ * grand() it is twelve random nibbles added up, giving -7 to +8 with
+ * a roughly Gaussian spread.  Each point uses the two hashes numbered
+ * by its place in the map.
+ */
+
+static void land_noise_c (unsigned int key, int x, int y, int step, int n, int *out)
+{
+	unsigned int cell;
+	int sum;
+	int i;
+
+	cell = x * (LAND_Y_MAX + 1) + y;
+
+	for (i = 0; i < n; i++, cell += step)
+	{
+		sum = nibble_sum (land_hash (key + cell * 2)) +
+			  nibble_sum (land_hash (key + cell * 2 + 1) & 0xFFFF);
+
+		out[i] = sum / 12 - 7;
+	}
+}
+
+
+#ifdef THREED_HAVE_SIMD
+
+__attribute__((target("avx2")))
+static __m256i land_hash_avx2 (__m256i h)
+{
+	h = _mm256_xor_si256 (h, _mm256_srli_epi32 (h, 16));
+	h = _mm256_mullo_epi32 (h, _mm256_set1_epi32 (0x7feb352d));
+	h = _mm256_xor_si256 (h, _mm256_srli_epi32 (h, 15));
+	h = _mm256_mullo_epi32 (h, _mm256_set1_epi32 ((int)0x846ca68b));
+	h = _mm256_xor_si256 (h, _mm256_srli_epi32 (h, 16));
+
+	return h;
+}
+
+
+__attribute__((target("avx2")))
+static __m256i nibble_sum_avx2 (__m256i h)
+{
+	__m256i m = _mm256_set1_epi32 (0x0F0F0F0F);
+
+	h = _mm256_add_epi32 (_mm256_and_si256 (h, m), _mm256_and_si256 (_mm256_srli_epi32 (h, 4), m));
+	h = _mm256_add_epi32 (h, _mm256_srli_epi32 (h, 8));
+	h = _mm256_add_epi32 (h, _mm256_srli_epi32 (h, 16));
+
+	return _mm256_and_si256 (h, _mm256_set1_epi32 (255));
+}
+
+
+/* Eight points at a time.  sum * 2731 >> 15 is sum / 12 for 0..180. */
+__attribute__((target("avx2")))
+static void land_noise_avx2 (unsigned int key, int x, int y, int step, int n, int *out)
+{
+	__m256i cell, lo, hi, sum;
+	__m256i k = _mm256_set1_epi32 (key);
+	__m256i next = _mm256_set1_epi32 (step * 8);
+	unsigned int first;
+	int i;
+
+	first = x * (LAND_Y_MAX + 1) + y;
+	cell = _mm256_add_epi32 (_mm256_set1_epi32 (first),
+							 _mm256_mullo_epi32 (_mm256_set1_epi32 (step),
+												 _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7)));
+
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		lo = _mm256_add_epi32 (k, _mm256_add_epi32 (cell, cell));
+		hi = _mm256_add_epi32 (lo, _mm256_set1_epi32 (1));
+
+		sum = _mm256_add_epi32 (nibble_sum_avx2 (land_hash_avx2 (lo)),
+								nibble_sum_avx2 (_mm256_and_si256 (land_hash_avx2 (hi),
+																   _mm256_set1_epi32 (0xFFFF))));
+		sum = _mm256_srli_epi32 (_mm256_mullo_epi32 (sum, _mm256_set1_epi32 (2731)), 15);
+		sum = _mm256_sub_epi32 (sum, _mm256_set1_epi32 (7));
+
+		_mm256_storeu_si256 ((__m256i *)(out + i), sum);
+		cell = _mm256_add_epi32 (cell, next);
+	}
+
+	if (i < n)
+		land_noise_c (key, x, y + i * step, step, n - i, out + i);
+}
+
+#endif
+
+
+static void select_land_noise (void)
+{
+	land_noise = land_noise_c;
+
+#ifdef THREED_HAVE_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports ("avx2"))
+		land_noise = land_noise_avx2;
+#endif
+}
+
+
+static int land_midpoint (int a, int b, int noise)
+{
+	int n;
+
+	n = ((a + b) / 2) + noise;
 	if (n < 0)
 		n = 0;
 	if (n > 255)
 		n = 255;
-	
+
 	return n;
-} 
+}
+
+
+struct land_level
+{
+	unsigned int key;
+	int w;						/* size of the squares being split */
+};
+
+
+/*
+ * Split one column of squares, the ones with their left edges at
+ * x = n * w.  The job makes the midpoints down the left edge and the
+ * column of top/bottom edge midpoints and centres through the middle;
+ * the last column makes its right edge as well.  No two jobs write the
+ * same point, and every point read was made by an earlier level or, for
+ * the centres, earlier in the same job.
+ */
+
+static void land_column (int n, void *arg)
+{
+	struct land_level *level = arg;
+	int noise[LAND_Y_MAX + 1];
+	int tx, mx, bx;
+	int w, d;
+	int y;
+
+	w = level->w;
+	d = w / 2;
+	tx = n * w;
+	mx = tx + d;
+	bx = tx + w;
+
+	land_noise (level->key, tx, d, w, LAND_Y_MAX / w, noise);
+	for (y = d; y < LAND_Y_MAX; y += w)
+		landscape[tx][y] = land_midpoint (landscape[tx][y - d], landscape[tx][y + d], noise[y / w]);
+
+	if (bx == LAND_X_MAX)
+	{
+		land_noise (level->key, bx, d, w, LAND_Y_MAX / w, noise);
+		for (y = d; y < LAND_Y_MAX; y += w)
+			landscape[bx][y] = land_midpoint (landscape[bx][y - d], landscape[bx][y + d], noise[y / w]);
+	}
+
+	/* Top and bottom edges first, then the centres between them. */
+
+	land_noise (level->key, mx, 0, d, LAND_Y_MAX / d + 1, noise);
+
+	for (y = 0; y <= LAND_Y_MAX; y += w)
+		landscape[mx][y] = land_midpoint (landscape[tx][y], landscape[bx][y], noise[y / d]);
+
+	for (y = d; y < LAND_Y_MAX; y += w)
+		landscape[mx][y] = land_midpoint (landscape[mx][y - d], landscape[mx][y + d], noise[y / d]);
+}
+
+
+/*
+ * Generate a fractal landscape.
+ * Uses midpoint displacement method.
+ *
+ * This leaves just which points of the full map are land (255) and
+ * which are sea (0); finish_fractal_landscape() does the rest.
+ */
+
+void generate_fractal_landscape (int rnd_seed)
+{
+	struct land_level level;
+	int x,y,d;
+
+	if (land_noise == NULL)
+		select_land_noise();
+
+	level.key = land_hash (rnd_seed);
+	
+	d = LAND_X_MAX / LAND_GRID;
+	
+	for (y = 0; y <= LAND_Y_MAX; y += d)
+		for (x = 0; x <= LAND_X_MAX; x += d)
+			landscape[x][y] = land_hash (level.key + (x * (LAND_Y_MAX + 1) + y) * 2) & 255;
+
+	for (level.w = d; level.w > 1; level.w /= 2)
+		gfx_run_parallel (land_column, LAND_X_MAX / level.w, &level);
+
+	for (y = 0; y <= LAND_Y_MAX; y++)
+		for (x = 0; x <= LAND_X_MAX; x++)
+			landscape[x][y] = (landscape[x][y] > 166) ? 255 : 0;
+}
+
+
+/*
+ * Make level k + 1 from level k, both holding how much of each point is
+ * land (0 to 255).  Each new point is a 1-2-1 weighted average of the
+ * three by three points around the same place on the bigger map.
+ */
+
+static void shrink_land_level (int k)
+{
+	const unsigned char *src;
+	const unsigned char *c0, *c1, *c2;
+	unsigned char *dst;
+	int sw, sh;
+	int w, h;
+	int x, y;
+	int y0, y1, y2;
+
+	src = land_level[k];
+	dst = land_level[k + 1];
+	sw = LAND_X_MAX >> k;
+	sh = LAND_Y_MAX >> k;
+	w = sw / 2;
+	h = sh / 2;
+
+	for (x = 0; x <= w; x++)
+	{
+		c0 = src + MAX(x * 2 - 1, 0) * (sh + 1);
+		c1 = src + x * 2 * (sh + 1);
+		c2 = src + MIN(x * 2 + 1, sw) * (sh + 1);
+
+		for (y = 0; y <= h; y++)
+		{
+			y0 = MAX(y * 2 - 1, 0);
+			y1 = y * 2;
+			y2 = MIN(y * 2 + 1, sh);
+
+			dst[x * (h + 1) + y] = (c0[y0] + 2 * c0[y1] + c0[y2] +
+									2 * (c1[y0] + 2 * c1[y1] + c1[y2]) +
+									c2[y0] + 2 * c2[y1] + c2[y2] + 8) / 16;
+		}
+	}
+}
+
+
+/*
+ * Turn the land of the full map into every level of coloured map.  The
+ * smaller levels are made from how much land there is rather than from
+ * the colours, so the coasts stay where they were.  The dark side is
+ * worked out as though each map were 128 across.
+ */
+
+static void finish_fractal_landscape (void)
+{
+	unsigned char *map;
+	int w, h;
+	int x, y;
+	int k;
+	double fx2;
+	double fy2[LAND_Y_MAX + 1];
+	int dark;
+	int land;
+
+	for (k = 0; k < LAND_LEVELS - 1; k++)
+		shrink_land_level (k);
+
+	for (k = 0; k < LAND_LEVELS; k++)
+	{
+		map = land_level[k];
+		w = LAND_X_MAX >> k;
+		h = LAND_Y_MAX >> k;
+
+		for (y = 0; y <= h; y++)
+			fy2[y] = (y * 128.0 / h) * (y * 128.0 / h);
+
+		for (x = 0; x <= w; x++)
+		{
+			fx2 = (x * 128.0 / w) * (x * 128.0 / w);
+
+			for (y = 0; y <= h; y++)
+			{
+				dark = (fx2 + fy2[y]) > 10000;
+				land = map[x * (h + 1) + y] >= 128;
+
+				if (land)
+					map[x * (h + 1) + y] = dark ? GFX_COL_GREEN_1 : GFX_COL_GREEN_2;
+				else
+					map[x * (h + 1) + y] = dark ? GFX_COL_BLUE_2 : GFX_COL_BLUE_1;
+			}
+		}
+	}
+}
+
+
+/*
+ * Fractal landscapes that have been made are kept, keyed by seed and
+ * style, so that launching from the same station again or trading back
+ * and forth between two planets doesn't make them all over again.  When
+ * the cache is full the one used longest ago is dropped.
+ *
+ * Only which points of the full map are land is kept, a bit each; the
+ * smaller levels and the colours are quick to make again from that.
+ *
+ * If landscape_cache_file is set the cache is also kept in
+ * LAND_CACHE_FILE between games.  The file holds a header and then the
+ * entries, most recently used first, each as a four byte seed, a style
+ * byte and the land bits.
+ */
+
+#define LAND_CACHE_SIZE		8
+#define LAND_CACHE_FILE		"landscape.dat"
+#define LAND_CACHE_VERSION	3
+#define LAND_BITS_SIZE		(((LAND_X_MAX + 1) * (LAND_Y_MAX + 1) + 7) / 8)
+
+struct land_cache_entry
+{
+	int style;					/* 0 = unused */
+	int seed;
+	unsigned int last_used;
+	unsigned char land[LAND_BITS_SIZE];
+};
+
+static struct land_cache_entry land_cache[LAND_CACHE_SIZE];
+static unsigned int land_clock = 0;
+static int land_cache_loaded = 0;
+
+
+static void load_landscape_cache (void)
+{
+	FILE *fp;
+	unsigned char header[10];
+	unsigned char key[5];
+	struct land_cache_entry *entry;
+	int count;
+	int i;
+
+	fp = fopen (LAND_CACHE_FILE, "rb");
+	if (fp == NULL)
+		return;
+
+	if ((fread (header, sizeof(header), 1, fp) != 1) ||
+		(memcmp (header, "NKLC", 4) != 0) ||
+		(header[4] != LAND_CACHE_VERSION) ||
+		((header[6] | (header[7] << 8)) != LAND_X_MAX) ||
+		((header[8] | (header[9] << 8)) != LAND_Y_MAX))
+	{
+		fclose (fp);
+		return;
+	}
 
+	count = MIN(header[5], LAND_CACHE_SIZE);
 
-/*
- * Calculate a square on the midpoint map.
- */
+	for (i = 0; i < count; i++)
+	{
+		entry = &land_cache[i];
 
-void midpoint_square (int tx, int ty, int w)
-{
-	int mx,my;
-	int bx,by;
-	int d;
+		if ((fread (key, sizeof(key), 1, fp) != 1) ||
+			(fread (entry->land, LAND_BITS_SIZE, 1, fp) != 1) ||
+			(key[4] != 3))
+		{
+			entry->style = 0;
+			break;
+		}
 
-	d = w / 2;	
-	mx = tx + d;
-	my = ty + d;
-	bx = tx + w;
-	by = ty + w;
-	
-	landscape[mx][ty] = calc_midpoint(tx,ty,bx,ty);
-	landscape[mx][by] = calc_midpoint(tx,by,bx,by);
-	landscape[tx][my] = calc_midpoint(tx,ty,tx,by);
-	landscape[bx][my] = calc_midpoint(bx,ty,bx,by);
-	landscape[mx][my] = calc_midpoint(tx,my,bx,my); 
+		entry->seed = key[0] | (key[1] << 8) | (key[2] << 16) | (key[3] << 24);
+		entry->style = key[4];
+		entry->last_used = count - i;
+	}
 
-	if (d == 1)
-		return;
-	
-	midpoint_square (tx,ty,d);
-	midpoint_square (mx,ty,d);
-	midpoint_square (tx,my,d);
-	midpoint_square (mx,my,d);
+	land_clock = count;
+	fclose (fp);
 }
 
 
-/*
- * Generate a fractal landscape.
- * Uses midpoint displacement method.
- */
-
-void generate_fractal_landscape (int rnd_seed)
+static void save_landscape_cache (void)
 {
-	int x,y,d,h;
-	double dist;
-	int dark;
-	int old_seed;
-	
-	old_seed = get_rand_seed();
-	set_rand_seed(rnd_seed);
-	
-	d = LAND_X_MAX / 8;
-	
-	for (y = 0; y <= LAND_Y_MAX; y += d)
-		for (x = 0; x <= LAND_X_MAX; x += d)
-			landscape[x][y] = randint() & 255;
+	FILE *fp;
+	unsigned char header[10];
+	unsigned char key[5];
+	struct land_cache_entry *order[LAND_CACHE_SIZE];
+	struct land_cache_entry *t;
+	int count;
+	int i, j;
 
-	for (y = 0; y < LAND_Y_MAX; y += d)
-		for (x = 0; x < LAND_X_MAX; x += d)	
-			midpoint_square (x,y,d);
+	count = 0;
 
-	for (y = 0; y <= LAND_Y_MAX; y++)
+	for (i = 0; i < LAND_CACHE_SIZE; i++)
+		if (land_cache[i].style != 0)
+			order[count++] = &land_cache[i];
+
+	for (i = 1; i < count; i++)
 	{
-		for (x = 0; x <= LAND_X_MAX; x++)
+		for (j = i; (j > 0) && (order[j]->last_used > order[j-1]->last_used); j--)
 		{
-			dist = x*x + y*y;
-			dark = dist > 10000;
-			h = landscape[x][y];
-			if (h > 166)
-				landscape[x][y] = dark ? GFX_COL_GREEN_1 : GFX_COL_GREEN_2;
-			else 
-				landscape[x][y] = dark ? GFX_COL_BLUE_2 : GFX_COL_BLUE_1;
-
+			t = order[j];
+			order[j] = order[j-1];
+			order[j-1] = t;
 		}
 	}
 
-	set_rand_seed (old_seed);
+	fp = fopen (LAND_CACHE_FILE, "wb");
+	if (fp == NULL)
+		return;
+
+	memcpy (header, "NKLC", 4);
+	header[4] = LAND_CACHE_VERSION;
+	header[5] = count;
+	header[6] = LAND_X_MAX & 255;
+	header[7] = LAND_X_MAX >> 8;
+	header[8] = LAND_Y_MAX & 255;
+	header[9] = LAND_Y_MAX >> 8;
+	fwrite (header, sizeof(header), 1, fp);
+
+	for (i = 0; i < count; i++)
+	{
+		key[0] = order[i]->seed & 255;
+		key[1] = (order[i]->seed >> 8) & 255;
+		key[2] = (order[i]->seed >> 16) & 255;
+		key[3] = (order[i]->seed >> 24) & 255;
+		key[4] = order[i]->style;
+
+		fwrite (key, sizeof(key), 1, fp);
+		fwrite (order[i]->land, LAND_BITS_SIZE, 1, fp);
+	}
+
+	fclose (fp);
 }
 
 
 void generate_landscape (int rnd_seed)
 {
+	struct land_cache_entry *entry;
+	unsigned char *map;
+	int i, j, n;
+
+	if (land_level[0] == NULL)
+		init_land_levels();
+
 	switch (planet_render_style)
 	{
 		case 0:		/* Wireframe... do nothing for now... */
-			break;
+			return;
 		
 		case 1:
 			/* generate_green_landscape (); */
-			break;
+			return;
 		
 		case 2:
 			generate_snes_landscape();
-			break;
-		
-		case 3:
-			generate_fractal_landscape (rnd_seed);
-			break;
+			return;
+	}
+
+	/* Fractal landscapes are worth keeping. */
+
+	if (landscape_cache_file && !land_cache_loaded)
+		load_landscape_cache();
+	land_cache_loaded = 1;
+
+	map = &landscape[0][0];
+	n = (LAND_X_MAX + 1) * (LAND_Y_MAX + 1);
+	entry = &land_cache[0];
+
+	for (i = 0; i < LAND_CACHE_SIZE; i++)
+	{
+		if ((land_cache[i].style == planet_render_style) &&
+			(land_cache[i].seed == rnd_seed))
+		{
+			entry = &land_cache[i];
+			entry->last_used = ++land_clock;
+
+			for (j = 0; j < n; j++)
+				map[j] = ((entry->land[j >> 3] >> (j & 7)) & 1) ? 255 : 0;
+
+			finish_fractal_landscape();
+			return;
+		}
+
+		if (land_cache[i].last_used < entry->last_used)
+			entry = &land_cache[i];
 	}
+
+	generate_fractal_landscape (rnd_seed);
+
+	entry->style = planet_render_style;
+	entry->seed = rnd_seed;
+	entry->last_used = ++land_clock;
+
+	memset (entry->land, 0, LAND_BITS_SIZE);
+	for (j = 0; j < n; j++)
+		if (map[j])
+			entry->land[j >> 3] |= 1 << (j & 7);
+
+	if (landscape_cache_file)
+		save_landscape_cache();
+
+	finish_fractal_landscape();
 }
 
  
  
 /*
  * Draw a line of the planet with appropriate rotation.
+ *
+ * The line is clipped to the view first and the landscape coordinates
+ * moved on to the first pixel left in.  They are then stepped along in
+ * fixed point (PLANET_FRAC fractional bits) rather than divided out for
+ * each pixel, and the row is handed over in one go.
+ *
+ * planet_map is the level of the landscape picked by render_planet(),
+ * planet_map_size points across.
  */
 
+#define PLANET_FRAC		24
+
+static unsigned char planet_span[GFX_VIEW_MAX_W];
+static const unsigned char *planet_map;
+static int planet_map_size;
+
 
 void render_planet_line (int xo, int yo, int x, int y, int radius, int vx, int vy)
 {
-	int lx, ly;
 	int rx, ry;
-	int colour;
 	int sx,sy;
 	int ex;
 	int div;
+	int i, n;
+	int lx, ly;
+	int64_t u, v;
+	int64_t du, dv;
 
 	sy = y + yo;
 	
@@ -557,27 +1769,54 @@ void render_planet_line (int xo, int yo, int x, int y, int radius, int vx, int v
 	ry = -x * vy + y * vx;
 	rx += radius << 16;
 	ry += radius << 16;
-	div = radius << 10;	 /* radius * 2 * LAND_X_MAX >> 16 */
-	
-		
-	for (; sx <= ex; sx++)
+	div = radius * (131072 / planet_map_size);	 /* radius * 2 * 65536 / size */
+
+	if (sx < GFX_VIEW_TX + GFX_X_OFFSET)
 	{
-		if ((sx >= (GFX_VIEW_TX + GFX_X_OFFSET)) && (sx <= (GFX_VIEW_BX + GFX_X_OFFSET)))
-		{
-			lx = rx / div;
-			ly = ry / div;
-			colour = landscape[lx][ly];
- 
-			gfx_fast_plot_pixel (sx, sy, colour);
-		}
-		rx += vx;
-		ry += vy;
+		rx += (GFX_VIEW_TX + GFX_X_OFFSET - sx) * vx;
+		ry += (GFX_VIEW_TX + GFX_X_OFFSET - sx) * vy;
+		sx = GFX_VIEW_TX + GFX_X_OFFSET;
 	}
+
+	if (ex > GFX_VIEW_BX + GFX_X_OFFSET)
+		ex = GFX_VIEW_BX + GFX_X_OFFSET;
+
+	n = ex - sx + 1;
+	if (n <= 0)
+		return;
+
+	u = (int64_t)rx * (1 << PLANET_FRAC) / div;
+	v = (int64_t)ry * (1 << PLANET_FRAC) / div;
+	du = (int64_t)vx * (1 << PLANET_FRAC) / div;
+	dv = (int64_t)vy * (1 << PLANET_FRAC) / div;
+
+	/*
+	 * The edge of the circle can reach just outside the map, so the
+	 * coordinates are kept inside it.
+	 */
+
+	for (i = 0; i < n; i++)
+	{
+		lx = (int)(u >> PLANET_FRAC);
+		ly = (int)(v >> PLANET_FRAC);
+		lx = MIN(MAX(lx, 0), planet_map_size);
+		ly = MIN(MAX(ly, 0), planet_map_size);
+
+		planet_span[i] = planet_map[lx * (planet_map_size + 1) + ly];
+
+		u += du;
+		v += dv;
+	}
+
+	gfx_draw_span (sx, sy, n, planet_span);
 }
 
 
 /*
  * Draw a solid planet.  Based on Doros circle drawing alogorithm.
+ *
+ * The landscape level used is the smallest that still has a point for
+ * every pixel across the planet.
  */
 
 void render_planet (int xo, int yo, int radius, struct vector *vec)
@@ -585,6 +1824,17 @@ void render_planet (int xo, int yo, int radius, struct vector *vec)
 	int x,y;
 	int s;
 	int vx,vy;
+	int k;
+
+	if ((radius <= 0) || (land_level[0] == NULL))
+		return;
+
+	k = 0;
+	while ((k < LAND_LEVELS - 1) && ((LAND_X_MAX >> (k + 1)) >= radius * 2))
+		k++;
+
+	planet_map = land_level[k];
+	planet_map_size = LAND_X_MAX >> k;
 
 	xo += GFX_X_OFFSET;
 	yo += GFX_Y_OFFSET;
@@ -635,31 +1885,23 @@ void draw_wireframe_planet (int xo, int yo, int radius, struct vector *vec)
  * - SNES Elite style.
  */
 
-void draw_planet (struct univ_object *planet)
+void draw_planet (struct univ_object *planet, struct view_object *view)
 {
 	int x,y;
 	int radius;
 	
-	x = (planet->location.x * 256) / planet->location.z;
-	y = (planet->location.y * 256) / planet->location.z;
-
-	y = -y;
-	
-	x += 128;
-	y += 96;
-
-	x *= GFX_SCALE;
-	y *= GFX_SCALE;
+	x = view->sx;
+	y = view->sy;
 	
 	radius = 6291456 / planet->distance;
 //	radius = 6291456 / ship_vec.z;   /* Planets are BIG! */
 
-	radius *= GFX_SCALE;
+	radius = (int)((int64_t)radius * PROJ_SCALE / 256);
 
-	if ((x + radius <  0) ||
-		(x - radius > 511) ||
-		(y + radius < 0) ||
-		(y - radius > 383))
+	if ((x + radius < VIEW_LEFT) ||
+		(x - radius > VIEW_RIGHT) ||
+		(y + radius < VIEW_TOP) ||
+		(y - radius > VIEW_BOTTOM))
 		return; 
 
 	switch (planet_render_style)
@@ -680,26 +1922,113 @@ void draw_planet (struct univ_object *planet)
 }
 
 
+/*
+ * The sun is drawn a row at a time.  Where the row crosses the edge of
+ * each ring is worked out straight from the ring's radius, the rings are
+ * laid into the row as solid runs over a dithered halo, and the row is
+ * handed over in one go.  The flicker comes from a table of noise that
+ * is stepped on each frame, so drawing the sun leaves the game's random
+ * numbers alone.
+ */
+
+#define SUN_NOISE_SIZE	256
+
+static unsigned char sun_noise[SUN_NOISE_SIZE + 4];
+static int sun_noise_ready = 0;
+static int sun_phase = 0;
+
+static unsigned char sun_span[GFX_VIEW_MAX_W];
+static unsigned char sun_halo[GFX_VIEW_MAX_W + 1];
+
+
+static void init_sun_noise (void)
+{
+	unsigned int seed;
+	int i;
+
+	seed = 12345;
+
+	for (i = 0; i < SUN_NOISE_SIZE; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		sun_noise[i] = (seed >> 16) & 7;
+	}
+
+	for (i = 0; i < 4; i++)
+		sun_noise[SUN_NOISE_SIZE + i] = sun_noise[i];
+
+	for (i = 0; i < GFX_VIEW_MAX_W + 1; i++)
+		sun_halo[i] = (i & 1) ? GFX_ORANGE_1 : GFX_ORANGE_2;
+
+	sun_noise_ready = 1;
+}
+
+
+/*
+ * How far either side of the centre a ring reaches on a row; that is
+ * the largest dx with dx * dx < n, where n is the ring's radius squared
+ * less dy squared.  -1 if the ring misses the row.
+ */
+
+static int sun_reach (int n)
+{
+	int d;
+
+	if (n <= 0)
+		return -1;
+
+	d = (int)sqrt ((double)n);
+
+	while (d * d >= n)
+		d--;
+
+	while ((d + 1) * (d + 1) < n)
+		d++;
+
+	return d;
+}
+
+
+/*
+ * Lay a run of one colour from xo - reach to xo + reach into the row,
+ * which starts at screen x sx and runs to ex.
+ */
+
+static void sun_run (int xo, int reach, int sx, int ex, int colour)
+{
+	int from, to;
+
+	if (reach < 0)
+		return;
+
+	from = MAX(xo - reach, sx);
+	to = MIN(xo + reach, ex);
+
+	if (from <= to)
+		memset (&sun_span[from - sx], colour, to - from + 1);
+}
+
+
 void render_sun_line (int xo, int yo, int x, int y, int radius)
 {
 	int sy = yo + y;
 	int sx,ex;
-	int colour;
-	int dx,dy;
-	int distance;
+	int dy;
 	int inner,outer;
 	int inner2;
-	int mix;
+	const unsigned char *noise;
 
 	if ((sy < GFX_VIEW_TY + GFX_Y_OFFSET) ||
 		(sy > GFX_VIEW_BY + GFX_Y_OFFSET))
 		return;
+
+	noise = &sun_noise[(sy * 5 + sun_phase) & (SUN_NOISE_SIZE - 1)];
 	
 	sx = xo - x;
 	ex = xo + x;
 
-	sx -= (radius * (2 + (randint() & 7))) >> 8;
-	ex += (radius * (2 + (randint() & 7))) >> 8;
+	sx -= (radius * (2 + noise[0])) >> 8;
+	ex += (radius * (2 + noise[1])) >> 8;
 	
 	if ((sx > GFX_VIEW_BX + GFX_X_OFFSET) ||
 		(ex < GFX_VIEW_TX + GFX_X_OFFSET))
@@ -711,34 +2040,26 @@ void render_sun_line (int xo, int yo, int x, int y, int radius)
 	if (ex > GFX_VIEW_BX + GFX_X_OFFSET)
 		ex = GFX_VIEW_BX + GFX_X_OFFSET;
 
-	inner = (radius * (200 + (randint() & 7))) >> 8;
+	inner = (radius * (200 + noise[2])) >> 8;
 	inner *= inner;
 	
-	inner2 = (radius * (220 + (randint() & 7))) >> 8;
+	inner2 = (radius * (220 + noise[3])) >> 8;
 	inner2 *= inner2;
 	
-	outer = (radius * (239 + (randint() & 7))) >> 8;
+	outer = (radius * (239 + noise[4])) >> 8;
 	outer *= outer;	
 
 	dy = y * y;
-	dx = sx - xo;
-	
-	for (; sx <= ex; sx++,dx++)
-	{
-		mix = (sx ^ y) & 1;
-		distance = dx * dx + dy;
 
-		if (distance < inner)
-			colour = GFX_COL_WHITE;
-		else if (distance < inner2)
-			colour = GFX_COL_YELLOW_4;
-		else if (distance < outer)
-			colour = GFX_ORANGE_3;
-		else
-			colour = mix ? GFX_ORANGE_1 : GFX_ORANGE_2;
-		
-		gfx_fast_plot_pixel (sx, sy, colour);
-	} 	
+	/* The halo is dithered between two oranges on alternate pixels. */
+
+	memcpy (sun_span, &sun_halo[(sx ^ y) & 1], ex - sx + 1);
+
+	sun_run (xo, sun_reach (outer - dy), sx, ex, GFX_ORANGE_3);
+	sun_run (xo, sun_reach (inner2 - dy), sx, ex, GFX_COL_YELLOW_4);
+	sun_run (xo, sun_reach (inner - dy), sx, ex, GFX_COL_WHITE);
+
+	gfx_draw_span (sx, sy, ex - sx + 1, sun_span);
 }
 
 
@@ -749,6 +2070,11 @@ void render_sun (int xo, int yo, int radius)
 	
 	xo += GFX_X_OFFSET;
 	yo += GFX_Y_OFFSET;
+
+	if (!sun_noise_ready)
+		init_sun_noise();
+
+	sun_phase = (sun_phase + 89) & (SUN_NOISE_SIZE - 1);
 	
 	s = -radius;
 	x = radius;
@@ -774,30 +2100,22 @@ void render_sun (int xo, int yo, int radius)
 
 
 
-void draw_sun (struct univ_object *planet)
+void draw_sun (struct univ_object *planet, struct view_object *view)
 {
 	int x,y;
 	int radius;
 	
-	x = (planet->location.x * 256) / planet->location.z;
-	y = (planet->location.y * 256) / planet->location.z;
-
-	y = -y;
-	
-	x += 128;
-	y += 96;
-
-	x *= GFX_SCALE;
-	y *= GFX_SCALE;
+	x = view->sx;
+	y = view->sy;
 	
 	radius = 6291456 / planet->distance;
 
-	radius *= GFX_SCALE;
+	radius = (int)((int64_t)radius * PROJ_SCALE / 256);
 
-	if ((x + radius <  0) ||
-		(x - radius > 511) ||
-		(y + radius < 0) ||
-		(y - radius > 383))
+	if ((x + radius < VIEW_LEFT) ||
+		(x - radius > VIEW_RIGHT) ||
+		(y + radius < VIEW_TOP) ||
+		(y - radius > VIEW_BOTTOM))
 		return; 
 
 	render_sun (x, y, radius);
@@ -805,32 +2123,135 @@ void draw_sun (struct univ_object *planet)
 
 
 
-void draw_explosion (struct univ_object *univ)
+/*
+ * Explosion particles.  When a ship starts to explode it is given a
+ * run of the pool holding 16 particles for each of its points, with
+ * the direction and size of each chosen once from exp_seed.  After
+ * that a frame only scales the directions by how far the explosion
+ * has spread, with no random numbers, and all the particles go to the
+ * screen in one call.  draw_ship() works on a copy of the universe
+ * entry, so runs are found by seed and type rather than by slot.
+ */
+
+#define EXP_PARTICLES	16
+#define EXP_RUNS		MAX_UNIV_OBJECTS
+#define EXP_RUN_SIZE	(100 * EXP_PARTICLES)
+
+struct explosion_run
+{
+	int type;					/* 0 when the run is free */
+	int seed;
+	unsigned int last_used;
+};
+
+static struct explosion_run exp_runs[EXP_RUNS];
+static unsigned int exp_clock;
+
+static signed char exp_dx[EXP_RUNS][EXP_RUN_SIZE];
+static signed char exp_dy[EXP_RUNS][EXP_RUN_SIZE];
+static unsigned char exp_w[EXP_RUNS][EXP_RUN_SIZE];
+static unsigned char exp_h[EXP_RUNS][EXP_RUN_SIZE];
+
+static int exp_x[EXP_RUN_SIZE];
+static int exp_y[EXP_RUN_SIZE];
+static unsigned char exp_vis_w[EXP_RUN_SIZE];
+static unsigned char exp_vis_h[EXP_RUN_SIZE];
+
+
+static int find_explosion (struct univ_object *univ)
+{
+	int i;
+
+	for (i = 0; i < EXP_RUNS; i++)
+	{
+		if ((exp_runs[i].type == univ->type) && (exp_runs[i].seed == univ->exp_seed))
+			return i;
+	}
+
+	return -1;
+}
+
+
+/*
+ * Give an exploding ship its particles, reusing the run that has gone
+ * longest without being drawn.  A run that is taken back is only made
+ * again from the same seed if its ship turns up later.
+ */
+
+static int spawn_explosion (struct univ_object *univ)
+{
+	int i, n;
+	int run;
+	int old_seed;
+
+	run = find_explosion (univ);
+	if (run != -1)
+		return run;
+
+	run = 0;
+	for (i = 0; i < EXP_RUNS; i++)
+	{
+		if (exp_runs[i].type == 0)
+		{
+			run = i;
+			break;
+		}
+
+		if (exp_runs[i].last_used < exp_runs[run].last_used)
+			run = i;
+	}
+
+	exp_runs[run].type = univ->type;
+	exp_runs[run].seed = univ->exp_seed;
+	exp_runs[run].last_used = exp_clock;
+
+	old_seed = get_rand_seed();
+	set_rand_seed (univ->exp_seed);
+
+	n = ship_models[univ->type].num_points * EXP_PARTICLES;
+
+	for (i = 0; i < n; i++)
+	{
+		exp_dx[run][i] = rand255() - 128;
+		exp_dy[run][i] = rand255() - 128;
+		exp_w[run][i] = (randint() & 1) + 1;
+		exp_h[run][i] = (randint() & 1) + 1;
+	}
+
+	set_rand_seed (old_seed);
+
+	return run;
+}
+
+
+
+void draw_explosion (struct univ_object *univ, struct view_object *view)
 {
 	int i;
 	int z;
 	int q;
 	int pr;
-	int px,py;
 	int cnt;
-	int sizex,sizey,psx,psy;
-	Matrix trans_mat;
+	int run;
 	int sx,sy;
-	double rx,ry,rz;
+	int np;
+	int first;
 	int visible[32];
-	struct vector vec;
 	struct vector camera_vec;
 	double cos_angle;
-	double tmp;
-	struct ship_face_normal *ship_norm;
-	struct ship_point *sp;
-	struct ship_data *ship;
-	int np;
-	int old_seed;
+	unsigned char *faces;
+	float xs[100], ys[100], zs[100];
+	unsigned char point_no[100];
+	struct projection proj;
+	struct ship_model *model;
 	
 	
 	if (univ->exp_delta > 251)
 	{
+		run = find_explosion (univ);
+		if (run != -1)
+			exp_runs[run].type = 0;
+
 		univ->flags |= FLG_REMOVE;
 		return;
 	}
@@ -840,76 +2261,43 @@ void draw_explosion (struct univ_object *univ)
 	if (univ->location.z <= 0)
 		return;
 
-	ship = ship_list[univ->type];
-	
-	for (i = 0; i < 3; i++)
-		trans_mat[i] = univ->rotmat[i];
-		
-	camera_vec = univ->location;
-	mult_vector (&camera_vec, trans_mat);
-	camera_vec = unit_vector (&camera_vec);
+	run = spawn_explosion (univ);
+	exp_runs[run].last_used = ++exp_clock;
+
+	model = &ship_models[univ->type];
 	
-	ship_norm = ship->normals;
+	camera_vec = unit_vector (&view->eye);
 	
-	for (i = 0; i < ship->num_faces; i++)
+	for (i = 0; i < model->num_faces; i++)
 	{
-		vec.x = ship_norm[i].x;
-		vec.y = ship_norm[i].y;
-		vec.z = ship_norm[i].z;
-
-		vec = unit_vector (&vec);
-		cos_angle = vector_dot_product (&vec, &camera_vec);
+		cos_angle = model->nx[i] * camera_vec.x + model->ny[i] * camera_vec.y +
+					model->nz[i] * camera_vec.z;
 
 		visible[i] = (cos_angle < -0.13);
 	}
 
-	tmp = trans_mat[0].y;
-	trans_mat[0].y = trans_mat[1].x;
-	trans_mat[1].x = tmp;
-
-	tmp = trans_mat[0].z;
-	trans_mat[0].z = trans_mat[2].x;
-	trans_mat[2].x = tmp;
+	/* Gather the points on visible faces and project them together. */
 
-	tmp = trans_mat[1].z;
-	trans_mat[1].z = trans_mat[2].y;
-	trans_mat[2].y = tmp;
-	
-	sp = ship->points;
 	np = 0;
 	
-	for (i = 0; i < ship->num_points; i++)
+	for (i = 0; i < model->num_points; i++)
 	{
-		if (visible[sp[i].face1] || visible[sp[i].face2] ||
-			visible[sp[i].face3] || visible[sp[i].face4])
-		{
-			vec.x = sp[i].x;
-			vec.y = sp[i].y;
-			vec.z = sp[i].z;
-
-			mult_vector (&vec, trans_mat);
+		faces = &model->faces[i * 4];
 
-			rx = vec.x + univ->location.x;
-			ry = vec.y + univ->location.y;
-			rz = vec.z + univ->location.z;
-
-			sx = (rx * 256) / rz;
-			sy = (ry * 256) / rz;
-
-			sy = -sy;
-
-			sx += 128;
-			sy += 96;
-
-			sx *= GFX_SCALE;
-			sy *= GFX_SCALE;
-
-			point_list[np].x = sx;
-			point_list[np].y = sy;
+		if (visible[faces[0]] || visible[faces[1]] ||
+			visible[faces[2]] || visible[faces[3]])
+		{
+			xs[np] = model->xs[i];
+			ys[np] = model->ys[i];
+			zs[np] = model->zs[i];
+			point_no[np] = i;
 			np++;
 		}
 	}
 
+	setup_projection (&proj, view->trans, univ, 0);
+	project_points (&proj, np, xs, ys, zs, point_list);
+
 	
 	z = (int)univ->location.z;
 	
@@ -919,42 +2307,26 @@ void draw_explosion (struct univ_object *univ)
 		q = (z / 32) | 1;
 
 	pr = (univ->exp_delta * 256) / q;
-	
-//	if (pr > 0x1C00)
-//		q = 254;
-//	else
-
 	q = pr / 32;	
 		
-	old_seed = get_rand_seed();
-	set_rand_seed (univ->exp_seed);
+	/* Spread each point's particles out around it. */
 
 	for (cnt = 0; cnt < np; cnt++)
 	{
 		sx = point_list[cnt].x;
 		sy = point_list[cnt].y;
+		first = point_no[cnt] * EXP_PARTICLES;
 	
-		for (i = 0; i < 16; i++)
+		for (i = 0; i < EXP_PARTICLES; i++)
 		{
-			px = rand255() - 128;
-			py = rand255() - 128;		
-
-			px = (px * q) / 256;
-			py = (py * q) / 256;
-		
-			px = px + px + sx;
-			py = py + py + sy;
-
-			sizex = (randint() & 1) + 1;
-			sizey = (randint() & 1) + 1;
-
-			for (psy = 0; psy < sizey; psy++)
-				for (psx = 0; psx < sizex; psx++)		
-					gfx_plot_pixel (px+psx, py+psy, GFX_COL_WHITE);
+			exp_x[cnt * EXP_PARTICLES + i] = ((exp_dx[run][first + i] * q) / 256) * PROJ_SCALE / 256 + sx;
+			exp_y[cnt * EXP_PARTICLES + i] = ((exp_dy[run][first + i] * q) / 256) * PROJ_SCALE / 256 + sy;
+			exp_vis_w[cnt * EXP_PARTICLES + i] = exp_w[run][first + i];
+			exp_vis_h[cnt * EXP_PARTICLES + i] = exp_h[run][first + i];
 		}
 	}
 
-	set_rand_seed (old_seed);
+	gfx_draw_particles (np * EXP_PARTICLES, exp_x, exp_y, exp_vis_w, exp_vis_h, GFX_COL_WHITE);
 }
 
 
@@ -964,7 +2336,7 @@ void draw_explosion (struct univ_object *univ)
  * (Ship, Planet, Sun etc).
  */
 
-void draw_ship (struct univ_object *ship)
+void draw_ship (struct univ_object *ship, struct view_object *view)
 {
 
 	if ((current_screen != SCR_FRONT_VIEW) && (current_screen != SCR_REAR_VIEW) && 
@@ -978,36 +2350,39 @@ void draw_ship (struct univ_object *ship)
 		ship->flags |= FLG_EXPLOSION;
 		ship->exp_seed = randint();
 		ship->exp_delta = 18; 
+		spawn_explosion (ship);
 	}
 
 	if (ship->flags & FLG_EXPLOSION)
 	{
-		draw_explosion (ship);
+		draw_explosion (ship, view);
 		return;
 	}
 	
-	if (ship->location.z <= 0)	/* Only display ships in front of us. */
-		return;
-
-	if (ship->type == SHIP_PLANET)
+	if ((ship->type == SHIP_PLANET) || (ship->type == SHIP_SUN))
 	{
-		draw_planet (ship);
+		if (ship->location.z <= 0)	/* Only display objects in front of us. */
+			return;
+
+		if (ship->type == SHIP_PLANET)
+			draw_planet (ship, view);
+		else
+			draw_sun (ship, view);
 		return;
 	}
+	
+	if (!ship_in_view (ship))	/* Check for field of vision. */
+		return;
 
-	if (ship->type == SHIP_SUN)
+	if (ship_vanished (ship))
 	{
-		draw_sun (ship);
+		draw_ship_dot (view);
 		return;
 	}
-	
-	if ((fabs(ship->location.x) > ship->location.z) ||	/* Check for field of vision. */
-		(fabs(ship->location.y) > ship->location.z))
-		return;
 		
 	if (wireframe)
-		draw_wireframe_ship (ship);
+		draw_wireframe_ship (ship, view);
 	else
-		draw_solid_ship (ship);
+		draw_solid_ship (ship, view);
 }
 
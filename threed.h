@@ -17,7 +17,9 @@
 
 #include "space.h"
 
-void draw_ship (struct univ_object *ship);
+int init_ship_models (void);
+void setup_view (struct view_object *view);
+void draw_ship (struct univ_object *ship, struct view_object *view);
 void generate_landscape (int rnd_seed);
 
 #endif